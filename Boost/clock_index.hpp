@@ -0,0 +1,190 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include <boost/container/vector.hpp>
+
+// Core of clock_set and clock_map: keys live in a flat array of slots with a
+// reference bit per slot, an open addressing table maps keys to slots.
+//
+// Lookups only read the table and set the reference bit with a relaxed store,
+// so any number of threads may call find_slot()/touch() at the same time.
+// insert() needs exclusive access.
+template <typename Key, typename Hash, typename Equal>
+class clock_index {
+public:
+    using slot_t = uint32_t;
+
+    static constexpr slot_t npos = std::numeric_limits<slot_t>::max();
+
+    static constexpr bool is_transparent = requires {
+        typename Hash::is_transparent;
+        typename Equal::is_transparent;
+    };
+
+    template <typename K>
+    static decltype(auto) lookup_key(const K& key)
+    {
+        if constexpr (is_transparent || std::is_same_v<K, Key>) {
+            return (key);
+        } else {
+            return Key(key);
+        }
+    }
+
+    // Throws std::invalid_argument for a max_size of 0, the hand would have no slot to sweep
+    explicit clock_index(std::size_t max_size)
+        : max_size_(max_size != 0 ? max_size : throw std::invalid_argument("clock_index: max_size must be positive"))
+        , hash_()
+        , equal_()
+        , keys_()
+        , hashes_()
+        , referenced_(new std::atomic<bool>[max_size])
+        , table_(std::bit_ceil(std::max<std::size_t>(2 * max_size, 2)), npos)
+        , hand_(0)
+    {
+        keys_.reserve(max_size_);
+        hashes_.reserve(max_size_);
+    }
+
+    template <typename K>
+    slot_t find_slot(const K& key) const
+    {
+        std::size_t hash = hash_(key);
+        for (std::size_t pos = home(hash);; pos = next(pos)) {
+            slot_t slot = table_[pos];
+            if (slot == npos) {
+                return npos;
+            }
+            if (hashes_[slot] == hash && equal_(keys_[slot], key)) {
+                return slot;
+            }
+        }
+    }
+
+    void touch(slot_t slot) const noexcept
+    {
+        referenced_[slot].store(true, std::memory_order_relaxed);
+    }
+
+    // Returns slot of the key and whether it was inserted. When the index is full
+    // the clock hand sweeps over the slots clearing reference bits and the first
+    // unreferenced one is reused.
+    template <typename K>
+    std::pair<slot_t, bool> insert(const K& key)
+    {
+        decltype(auto) lookup = lookup_key(key);
+        slot_t slot           = find_slot(lookup);
+        if (slot != npos) {
+            touch(slot);
+            return { slot, false };
+        }
+
+        std::size_t hash = hash_(lookup);
+        if (keys_.size() < max_size_) {
+            slot = static_cast<slot_t>(keys_.size());
+            keys_.emplace_back(std::forward<decltype(lookup)>(lookup));
+            hashes_.push_back(hash);
+        } else {
+            slot = sweep();
+            unlink(slot);
+            keys_[slot]   = Key(std::forward<decltype(lookup)>(lookup));
+            hashes_[slot] = hash;
+        }
+
+        referenced_[slot].store(false, std::memory_order_relaxed);
+        link(slot);
+        return { slot, true };
+    }
+
+    const Key& key(slot_t slot) const noexcept
+    {
+        return keys_[slot];
+    }
+
+    const boost::container::vector<Key>& keys() const noexcept
+    {
+        return keys_;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return keys_.size();
+    }
+
+    std::size_t max_size() const noexcept
+    {
+        return max_size_;
+    }
+
+private:
+    std::size_t home(std::size_t hash) const noexcept
+    {
+        // Fibonacci hashing, so weak hashes like std::hash<int> still spread
+        return (hash * 0x9E3779B97F4A7C15ULL) >> (64 - std::countr_zero(table_.size()));
+    }
+
+    std::size_t next(std::size_t pos) const noexcept
+    {
+        return (pos + 1) & (table_.size() - 1);
+    }
+
+    slot_t sweep() noexcept
+    {
+        while (referenced_[hand_].exchange(false, std::memory_order_relaxed)) {
+            hand_ = (hand_ + 1) % max_size_;
+        }
+        slot_t ret = hand_;
+        hand_      = (hand_ + 1) % max_size_;
+        return ret;
+    }
+
+    void link(slot_t slot) noexcept
+    {
+        std::size_t pos = home(hashes_[slot]);
+        while (table_[pos] != npos) {
+            pos = next(pos);
+        }
+        table_[pos] = slot;
+    }
+
+    // Backward shift deletion, linear probing needs no tombstones
+    void unlink(slot_t slot) noexcept
+    {
+        std::size_t pos = home(hashes_[slot]);
+        while (table_[pos] != slot) {
+            pos = next(pos);
+        }
+
+        std::size_t hole = pos;
+        for (pos = next(pos); table_[pos] != npos; pos = next(pos)) {
+            std::size_t wanted = home(hashes_[table_[pos]]);
+            // Move the entry into the hole unless its home lies cyclically in (hole, pos]
+            bool stays = hole <= pos ? (hole < wanted && wanted <= pos) : (hole < wanted || wanted <= pos);
+            if (!stays) {
+                table_[hole] = table_[pos];
+                hole         = pos;
+            }
+        }
+        table_[hole] = npos;
+    }
+
+    std::size_t max_size_;
+    Hash hash_;
+    Equal equal_;
+    boost::container::vector<Key> keys_;
+    boost::container::vector<std::size_t> hashes_;
+    std::unique_ptr<std::atomic<bool>[]> referenced_;
+    boost::container::vector<slot_t> table_;
+    slot_t hand_;
+};
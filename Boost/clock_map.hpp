@@ -0,0 +1,75 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include "clock_index.hpp"
+
+// CLOCK (second chance) sibling of lru_map with the same contains/put interface.
+// Values sit in a flat array next to the keys. Lookups only set a reference bit,
+// so contains()/find() may run from many threads at once, while put() needs
+// exclusive access.
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename Equal = std::equal_to<Key>>
+class clock_map {
+public:
+    using index = clock_index<Key, Hash, Equal>;
+
+private:
+    index index_;
+    boost::container::vector<Value> values_;
+
+public:
+    clock_map(size_t max_size)
+        : index_(max_size)
+        , values_()
+    {
+        values_.reserve(max_size);
+    }
+
+    template <typename K = Key>
+    bool contains(const K& key) const
+    {
+        return find(key) != nullptr;
+    }
+
+    template <typename K = Key>
+    const Value* find(const K& key) const
+    {
+        auto slot = index_.find_slot(index::lookup_key(key));
+        if (slot == index::npos) {
+            return nullptr;
+        }
+
+        index_.touch(slot);
+        return &values_[slot];
+    }
+
+    template <typename K = Key>
+    bool put(const K& key, Value&& value)
+    {
+        auto [slot, inserted] = index_.insert(key);
+        if (!inserted) {
+            return false;
+        }
+
+        if (slot == values_.size()) {
+            values_.push_back(std::move(value));
+        } else {
+            values_[slot] = std::move(value);
+        }
+        return true;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return index_.size();
+    }
+
+    // Visits entries in slot order, which says nothing about recency
+    template <typename Func>
+    void for_each(Func&& func) const
+    {
+        for (typename index::slot_t slot = 0; slot < index_.size(); ++slot) {
+            func(index_.key(slot), values_[slot]);
+        }
+    }
+};
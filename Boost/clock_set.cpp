@@ -0,0 +1,126 @@
+// Copyright 2024 Severin Denisenko
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "clock_set.hpp"
+#include "lru_set.hpp"
+
+static constexpr uint32_t capacity_ { 1 << 16 };
+static constexpr uint32_t keys_ { capacity_ * 2 };
+static constexpr uint32_t ops_per_thread_ { 1 << 20 };
+static constexpr uint32_t read_percent_ { 95 };
+
+template <typename Set>
+void print(const Set& set)
+{
+    for (const auto& key : set) {
+        std::cout << fmt::format("{} ", key);
+    }
+    std::cout << std::endl;
+}
+
+// lru_set::contains() splices the list, so even readers need the exclusive lock
+struct locked_lru_set {
+    bool contains(uint32_t key)
+    {
+        std::unique_lock lock { mtx_ };
+        return set_.contains(key);
+    }
+
+    bool put(uint32_t key)
+    {
+        std::unique_lock lock { mtx_ };
+        return set_.put(key);
+    }
+
+    std::shared_mutex mtx_;
+    lru_set<uint32_t> set_ { capacity_ };
+};
+
+// clock_set::contains() only sets a bit, readers share the lock
+struct locked_clock_set {
+    bool contains(uint32_t key)
+    {
+        std::shared_lock lock { mtx_ };
+        return set_.contains(key);
+    }
+
+    bool put(uint32_t key)
+    {
+        std::unique_lock lock { mtx_ };
+        return set_.put(key);
+    }
+
+    std::shared_mutex mtx_;
+    clock_set<uint32_t> set_ { capacity_ };
+};
+
+template <typename Set>
+double run(Set& set, uint32_t threads)
+{
+    for (uint32_t key = 0; key < capacity_; ++key) {
+        set.put(key);
+    }
+
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t thread = 0; thread < threads; ++thread) {
+        workers.emplace_back([thread, &set]() {
+            std::mt19937 rng(thread);
+            std::uniform_int_distribution<uint32_t> key_dist(0, keys_ - 1);
+            std::uniform_int_distribution<uint32_t> op_dist(0, 99);
+
+            for (uint32_t op = 0; op < ops_per_thread_; ++op) {
+                uint32_t key = key_dist(rng);
+                if (op_dist(rng) < read_percent_) {
+                    set.contains(key);
+                } else {
+                    set.put(key);
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double> seconds = stop - start;
+    return threads * static_cast<double>(ops_per_thread_) / seconds.count();
+}
+
+int main()
+{
+    clock_set<int> set { 3 };
+
+    set.put(1);
+    set.put(2);
+    set.put(3);
+
+    print(set);
+
+    // 1 gets a second chance, 2 is replaced
+    set.contains(1);
+    set.put(4);
+
+    print(set);
+
+    uint32_t max_threads = std::max(2u, 2 * std::thread::hardware_concurrency());
+    std::cout << fmt::format("{:>8} {:>16} {:>16}\n", "threads", "lru_set", "clock_set");
+    for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+        locked_lru_set lru;
+        locked_clock_set clock;
+        std::cout << fmt::format("{:>8} {:>16.0f} {:>16.0f}\n", threads, run(lru, threads), run(clock, threads));
+    }
+
+    return 0;
+}
@@ -0,0 +1,59 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include "clock_index.hpp"
+
+// CLOCK (second chance) sibling of lru_set with the same contains/put interface.
+// Hits only set a reference bit, so contains() may run from many threads at once,
+// for example under a shared lock, while put() needs exclusive access.
+template <typename Key, typename Hash = std::hash<Key>, typename Equal = std::equal_to<Key>>
+class clock_set {
+public:
+    using index = clock_index<Key, Hash, Equal>;
+
+    using const_iterator = boost::container::vector<Key>::const_iterator;
+
+private:
+    index index_;
+
+public:
+    clock_set(size_t max_size)
+        : index_(max_size)
+    {
+    }
+
+    template <typename K = Key>
+    bool contains(const K& key) const
+    {
+        auto slot = index_.find_slot(index::lookup_key(key));
+        if (slot == index::npos) {
+            return false;
+        }
+
+        index_.touch(slot);
+        return true;
+    }
+
+    template <typename K = Key>
+    bool put(const K& key)
+    {
+        return index_.insert(key).second;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return index_.size();
+    }
+
+    // Iterates in slot order, which says nothing about recency
+    const_iterator begin() const
+    {
+        return index_.keys().begin();
+    }
+
+    const_iterator end() const
+    {
+        return index_.keys().end();
+    }
+};
@@ -0,0 +1,99 @@
+// Copyright 2024 Severin Denisenko
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "flat_lru_map.hpp"
+#include "lru_map.hpp"
+
+static constexpr uint32_t entries_ { 1 << 22 };
+static constexpr uint32_t lookups_ { 1 << 20 };
+
+template <typename Map>
+void print(Map& map)
+{
+    for (const auto& val : map) {
+        std::cout << fmt::format("({},  {}) ", val.get_key(), val.get_value());
+    }
+    std::cout << std::endl;
+}
+
+// Times every lookup separately, the cost of reading the clock is measured first and subtracted
+template <typename Map>
+void latency(const char* name)
+{
+    using clock = std::chrono::steady_clock;
+
+    // Random keys, sequential ones would give the identity std::hash a locality real keys lack
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> keys(entries_);
+    for (auto& key : keys) {
+        key = rng();
+    }
+
+    Map map { entries_ };
+    for (uint64_t key : keys) {
+        map.put(key, uint64_t { key });
+    }
+
+    // Half of the lookups hit
+    std::uniform_int_distribution<uint64_t> dist(0, entries_ - 1);
+
+    std::vector<int64_t> empty(lookups_);
+    for (auto& sample : empty) {
+        auto start = clock::now();
+        sample     = (clock::now() - start).count();
+    }
+    std::sort(empty.begin(), empty.end());
+    int64_t overhead = empty[empty.size() / 2];
+
+    std::vector<int64_t> samples(lookups_);
+    uint64_t found = 0;
+    for (auto& sample : samples) {
+        uint64_t key = rng() % 2 == 0 ? keys[dist(rng)] : rng();
+        auto start   = clock::now();
+        found += map.contains(key);
+        sample = std::max<int64_t>(0, (clock::now() - start).count() - overhead);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    auto percentile = [&samples](double p) {
+        return std::chrono::nanoseconds(clock::duration(samples[samples.size() * p])).count();
+    };
+    std::cout << fmt::format(
+        "{:>14} {:>8} {:>8} {:>8} {:>10}\n", name, percentile(0.5), percentile(0.99), percentile(0.999), found);
+}
+
+int main()
+{
+    flat_lru_map<int, int> map { 3 };
+
+    map.put(1, 1);
+    map.put(2, 2);
+    map.put(3, 3);
+
+    print(map);
+
+    map.put(4, 4);
+
+    print(map);
+
+    map.get_or_compute(5, []() { return 5; });
+    map.get(3) = 33;
+    map.erase(4);
+
+    print(map);
+
+    std::cout << fmt::format("{} entries, lookup latency in ns\n", entries_);
+    std::cout << fmt::format("{:>14} {:>8} {:>8} {:>8} {:>10}\n", "map", "p50", "p99", "p99.9", "found");
+    latency<lru_map<uint64_t, uint64_t>>("lru_map");
+    latency<flat_lru_map<uint64_t, uint64_t>>("flat_lru_map");
+
+    return 0;
+}
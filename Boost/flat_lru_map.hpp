@@ -0,0 +1,545 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <boost/container/vector.hpp>
+
+// lru_map without pointer chasing: an open addressing table in the style of
+// Swiss tables, where a group of 16 control bytes is matched with one SIMD
+// compare. The recency list is threaded through the table slots by 32 bit
+// positions and values live in a parallel array, so nothing is allocated per entry.
+//
+// Control byte is either empty, deleted or the low 7 bits of the key hash,
+// so most mismatches are rejected without touching keys.
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename Equal = std::equal_to<Key>>
+class flat_lru_map {
+public:
+    using index_t = uint32_t;
+
+    static constexpr index_t npos = std::numeric_limits<index_t>::max();
+
+    static constexpr std::size_t group_size = 16;
+
+    static constexpr int8_t ctrl_empty   = -128;
+    static constexpr int8_t ctrl_deleted = -2;
+
+    static constexpr bool is_transparent = requires {
+        typename Hash::is_transparent;
+        typename Equal::is_transparent;
+    };
+
+    class entry {
+    public:
+        entry(const Key& key, const Value& value)
+            : key_(key)
+            , value_(value)
+        {
+        }
+
+        const Key& get_key() const noexcept
+        {
+            return key_;
+        }
+
+        const Value& get_value() const noexcept
+        {
+            return value_;
+        }
+
+    private:
+        const Key& key_;
+        const Value& value_;
+    };
+
+    // Walks the recency list, least recently used first
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = entry;
+        using difference_type   = std::ptrdiff_t;
+        using reference         = entry;
+
+        const_iterator(const flat_lru_map* map, index_t index)
+            : map_(map)
+            , index_(index)
+        {
+        }
+
+        entry operator*() const
+        {
+            return entry(map_->key_of(index_), map_->values_[index_]);
+        }
+
+        const_iterator& operator++()
+        {
+            index_ = map_->slots_[index_].next_;
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        bool operator==(const const_iterator& other) const
+        {
+            return index_ == other.index_;
+        }
+
+    private:
+        const flat_lru_map* map_;
+        index_t index_;
+    };
+
+private:
+    // Bit i of every mask is set when control byte i matches
+    class group {
+    public:
+        explicit group(const int8_t* ctrl)
+#if defined(__SSE2__)
+            : ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl)))
+#else
+            : ctrl_(ctrl)
+#endif
+        {
+        }
+
+        uint32_t match(int8_t h2) const noexcept
+        {
+#if defined(__SSE2__)
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl_));
+#else
+            return match_if([h2](int8_t ctrl) { return ctrl == h2; });
+#endif
+        }
+
+        uint32_t match_empty() const noexcept
+        {
+#if defined(__SSE2__)
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(ctrl_empty), ctrl_));
+#else
+            return match_if([](int8_t ctrl) { return ctrl == ctrl_empty; });
+#endif
+        }
+
+        // Empty and deleted are the only negative control bytes
+        uint32_t match_free() const noexcept
+        {
+#if defined(__SSE2__)
+            return _mm_movemask_epi8(ctrl_);
+#else
+            return match_if([](int8_t ctrl) { return ctrl < 0; });
+#endif
+        }
+
+    private:
+#if defined(__SSE2__)
+        __m128i ctrl_;
+#else
+        template <typename Pred>
+        uint32_t match_if(Pred pred) const noexcept
+        {
+            uint32_t ret = 0;
+            for (std::size_t i = 0; i < group_size; ++i) {
+                ret |= static_cast<uint32_t>(pred(ctrl_[i])) << i;
+            }
+            return ret;
+        }
+
+        const int8_t* ctrl_;
+#endif
+    };
+
+    template <typename K>
+    static decltype(auto) lookup_key(const K& key)
+    {
+        if constexpr (is_transparent || std::is_same_v<K, Key>) {
+            return (key);
+        } else {
+            return Key(key);
+        }
+    }
+
+    template <typename Factory>
+    struct lazy_value {
+        Factory& factory_;
+
+        operator Value() const
+        {
+            return factory_();
+        }
+    };
+
+    // Key and recency links share one cache line, a hit touches no other array but values
+    struct slot {
+        template <typename K>
+        slot(K&& key)
+            : key_(std::forward<K>(key))
+            , prev_(npos)
+            , next_(npos)
+        {
+        }
+
+        Key key_;
+        index_t prev_;
+        index_t next_;
+    };
+
+    std::size_t max_size_;
+    Hash hash_;
+    Equal equal_;
+
+    // Slot i and value i hold live objects only while control byte i holds a hash
+    std::size_t groups_;
+    std::size_t growth_left_;
+    boost::container::vector<int8_t> ctrl_;
+    std::allocator<slot> slot_allocator_;
+    std::allocator<Value> value_allocator_;
+    slot* slots_;
+    Value* values_;
+
+    index_t head_;
+    index_t tail_;
+    std::size_t size_;
+
+    std::size_t table_size() const noexcept
+    {
+        return groups_ * group_size;
+    }
+
+    std::size_t max_load() const noexcept
+    {
+        return table_size() / 8 * 7;
+    }
+
+    template <typename K>
+    uint64_t hash(const K& key) const
+    {
+        // Multiply and fold, weak hashes like std::hash<int> still spread over groups
+        __uint128_t mixed = static_cast<__uint128_t>(hash_(key)) * 0x9E3779B97F4A7C15ULL;
+        return static_cast<uint64_t>(mixed) ^ static_cast<uint64_t>(mixed >> 64);
+    }
+
+    static int8_t h2(uint64_t hash) noexcept
+    {
+        return static_cast<int8_t>(hash & 0x7f);
+    }
+
+    const Key& key_of(index_t index) const noexcept
+    {
+        return slots_[index].key_;
+    }
+
+    template <typename K>
+    index_t find_slot(const K& key, uint64_t hash) const
+    {
+        std::size_t g = (hash >> 7) & (groups_ - 1);
+        // Triangular probing visits every group of a power of two table
+        for (std::size_t step = 1;; ++step) {
+            group current(&ctrl_[g * group_size]);
+            for (uint32_t bits = current.match(h2(hash)); bits != 0; bits &= bits - 1) {
+                std::size_t pos = g * group_size + std::countr_zero(bits);
+                if (equal_(slots_[pos].key_, key)) {
+                    return static_cast<index_t>(pos);
+                }
+            }
+            if (current.match_empty() != 0) {
+                return npos;
+            }
+            g = (g + step) & (groups_ - 1);
+        }
+    }
+
+    static index_t find_free_slot(const int8_t* ctrl, std::size_t groups, uint64_t hash) noexcept
+    {
+        std::size_t g = (hash >> 7) & (groups - 1);
+        for (std::size_t step = 1;; ++step) {
+            uint32_t bits = group(&ctrl[g * group_size]).match_free();
+            if (bits != 0) {
+                return static_cast<index_t>(g * group_size + std::countr_zero(bits));
+            }
+            g = (g + step) & (groups - 1);
+        }
+    }
+
+    index_t prepare_slot(uint64_t hash)
+    {
+        index_t pos = find_free_slot(ctrl_.data(), groups_, hash);
+        if (ctrl_[pos] == ctrl_empty && growth_left_ == 0) {
+            // Only deleted slots are left to take, drop them all at once
+            rehash();
+            pos = find_free_slot(ctrl_.data(), groups_, hash);
+        }
+        return pos;
+    }
+
+    void commit_slot(index_t pos, uint64_t hash) noexcept
+    {
+        if (ctrl_[pos] == ctrl_empty) {
+            --growth_left_;
+        }
+        ctrl_[pos] = h2(hash);
+    }
+
+    void release_slot(index_t pos) noexcept
+    {
+        std::destroy_at(&slots_[pos]);
+        std::destroy_at(&values_[pos]);
+        // A probe never passes a group with an empty byte, so the slot may become empty again
+        if (group(&ctrl_[pos - pos % group_size]).match_empty() != 0) {
+            ctrl_[pos] = ctrl_empty;
+            ++growth_left_;
+        } else {
+            ctrl_[pos] = ctrl_deleted;
+        }
+    }
+
+    // Moves live entries into a fresh table of the same size without tombstones,
+    // relinking them in the same recency order
+    void rehash()
+    {
+        boost::container::vector<int8_t> ctrl(table_size(), ctrl_empty);
+        slot* slots   = slot_allocator_.allocate(table_size());
+        Value* values = value_allocator_.allocate(table_size());
+
+        index_t tail = npos;
+        for (index_t pos = head_; pos != npos;) {
+            slot& old_slot    = slots_[pos];
+            uint64_t key_hash = hash(old_slot.key_);
+            index_t new_pos   = find_free_slot(ctrl.data(), groups_, key_hash);
+            std::construct_at(&slots[new_pos], std::move(old_slot.key_));
+            std::construct_at(&values[new_pos], std::move(values_[pos]));
+            ctrl[new_pos] = h2(key_hash);
+
+            slots[new_pos].prev_ = tail;
+            if (tail == npos) {
+                head_ = new_pos;
+            } else {
+                slots[tail].next_ = new_pos;
+            }
+            tail = new_pos;
+
+            index_t next = old_slot.next_;
+            std::destroy_at(&old_slot);
+            std::destroy_at(&values_[pos]);
+            pos = next;
+        }
+        tail_ = tail;
+
+        slot_allocator_.deallocate(slots_, table_size());
+        value_allocator_.deallocate(values_, table_size());
+        slots_  = slots;
+        values_ = values;
+        ctrl_.swap(ctrl);
+        growth_left_ = max_load() - size_;
+    }
+
+    void link_tail(index_t pos) noexcept
+    {
+        slots_[pos].prev_ = tail_;
+        slots_[pos].next_ = npos;
+        if (tail_ == npos) {
+            head_ = pos;
+        } else {
+            slots_[tail_].next_ = pos;
+        }
+        tail_ = pos;
+    }
+
+    void unlink(index_t pos) noexcept
+    {
+        slot& current = slots_[pos];
+        if (current.prev_ == npos) {
+            head_ = current.next_;
+        } else {
+            slots_[current.prev_].next_ = current.next_;
+        }
+        if (current.next_ == npos) {
+            tail_ = current.prev_;
+        } else {
+            slots_[current.next_].prev_ = current.prev_;
+        }
+    }
+
+    void promote(index_t pos) noexcept
+    {
+        if (pos != tail_) {
+            unlink(pos);
+            link_tail(pos);
+        }
+    }
+
+    void erase_slot(index_t pos) noexcept
+    {
+        unlink(pos);
+        release_slot(pos);
+        --size_;
+    }
+
+    template <typename K, typename... Args>
+    std::pair<index_t, bool> emplace_slot(const K& key, Args&&... args)
+    {
+        decltype(auto) lookup = lookup_key(key);
+        uint64_t key_hash     = hash(lookup);
+        index_t pos           = find_slot(lookup, key_hash);
+        if (pos != npos) {
+            promote(pos);
+            return { pos, false };
+        }
+        // The table always has room for one entry past max_size, so the entry is built
+        // before the oldest one goes and a throwing constructor evicts nothing
+        pos = prepare_slot(key_hash);
+        std::construct_at(&values_[pos], std::forward<Args>(args)...);
+        try {
+            std::construct_at(&slots_[pos], std::forward<decltype(lookup)>(lookup));
+        } catch (...) {
+            std::destroy_at(&values_[pos]);
+            throw;
+        }
+
+        commit_slot(pos, key_hash);
+        link_tail(pos);
+        if (++size_ > max_size_) {
+            erase_slot(head_);
+        }
+        return { pos, true };
+    }
+
+public:
+    // Throws std::invalid_argument for a max_size of 0, there would be nothing to evict
+    flat_lru_map(size_t max_size)
+        : max_size_(max_size != 0 ? max_size : throw std::invalid_argument("flat_lru_map: max_size must be positive"))
+        , hash_()
+        , equal_()
+        , groups_(std::bit_ceil(std::max<std::size_t>((max_size_ * 8 / 7 + group_size) / group_size, 1)))
+        , growth_left_(max_load())
+        , ctrl_(table_size(), ctrl_empty)
+        , slot_allocator_()
+        , value_allocator_()
+        , slots_(slot_allocator_.allocate(table_size()))
+        , values_(value_allocator_.allocate(table_size()))
+        , head_(npos)
+        , tail_(npos)
+        , size_(0)
+    {
+    }
+
+    flat_lru_map(const flat_lru_map&) = delete;
+
+    flat_lru_map& operator=(const flat_lru_map&) = delete;
+
+    ~flat_lru_map()
+    {
+        for (index_t pos = head_; pos != npos;) {
+            index_t next = slots_[pos].next_;
+            std::destroy_at(&slots_[pos]);
+            std::destroy_at(&values_[pos]);
+            pos = next;
+        }
+        slot_allocator_.deallocate(slots_, table_size());
+        value_allocator_.deallocate(values_, table_size());
+    }
+
+    template <typename K = Key>
+    bool contains(const K& key)
+    {
+        return find(key) != nullptr;
+    }
+
+    // Returns the value and marks it as recently used, nullptr if key is missing
+    template <typename K = Key>
+    Value* find(const K& key)
+    {
+        decltype(auto) lookup = lookup_key(key);
+        index_t index         = find_slot(lookup, hash(lookup));
+        if (index == npos) {
+            return nullptr;
+        }
+
+        promote(index);
+        return &values_[index];
+    }
+
+    // Looks up key without touching recency order
+    template <typename K = Key>
+    const Value* peek(const K& key) const
+    {
+        decltype(auto) lookup = lookup_key(key);
+        index_t index         = find_slot(lookup, hash(lookup));
+        return index == npos ? nullptr : &values_[index];
+    }
+
+    template <typename K = Key>
+    Value& get(const K& key)
+    {
+        Value* value = find(key);
+        if (value == nullptr) {
+            throw std::out_of_range("flat_lru_map::get: no such key");
+        }
+        return *value;
+    }
+
+    template <typename K = Key, typename... Args>
+    std::pair<Value*, bool> try_emplace(const K& key, Args&&... args)
+    {
+        auto [index, inserted] = emplace_slot(key, std::forward<Args>(args)...);
+        return { &values_[index], inserted };
+    }
+
+    template <typename K = Key, typename Factory>
+    Value& get_or_compute(const K& key, Factory&& factory)
+    {
+        return values_[emplace_slot(key, lazy_value<Factory> { factory }).first];
+    }
+
+    template <typename K = Key>
+    bool put(const K& key, Value&& value)
+    {
+        return emplace_slot(key, std::move(value)).second;
+    }
+
+    template <typename K = Key>
+    bool erase(const K& key)
+    {
+        decltype(auto) lookup = lookup_key(key);
+        index_t index         = find_slot(lookup, hash(lookup));
+        if (index == npos) {
+            return false;
+        }
+
+        erase_slot(index);
+        return true;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, head_);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, npos);
+    }
+};
@@ -0,0 +1,249 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#include <boost/core/demangle.hpp>
+#include <boost/format.hpp>
+#include <boost/msm/back/common_types.hpp>
+
+// Tracing policies for table_state_machine.
+//
+// The machine calls start() before and on_dispatch() after every event it
+// dispatches, replayed deferred events included, with the states before and
+// after, the result and how many events wait in the deferred ring. A result of
+// HANDLED_FALSE is a no_transition() call, HANDLED_GUARD_REJECT a rejection by
+// every guard. fsm_no_trace does nothing and compiles away, fsm_ring_trace
+// writes timestamped records into a ring of the calling thread.
+
+// One dispatched event. Types point to static type_info, names are made when dumped
+struct fsm_trace_record {
+    uint64_t time; // steady clock nanoseconds at dispatch
+    const void* machine;
+    const std::type_info* event;
+    const std::type_info* from;
+    const std::type_info* to;
+    uint32_t latency; // nanoseconds in the dispatch
+    uint32_t deferred;
+    uint32_t thread;
+    boost::msm::back::HandledEnum result;
+};
+
+struct fsm_no_trace {
+    struct timer { };
+
+    timer start() const noexcept
+    {
+        return {};
+    }
+
+    template <typename Machine, typename Event>
+    void on_dispatch(timer, const Machine&, const Event&, std::size_t, std::size_t, boost::msm::back::HandledEnum,
+        std::size_t) const noexcept
+    {
+    }
+};
+
+// Last Capacity records of one thread. Only the owner writes, anyone may read.
+//
+// A seqlock with head_ as the sequence: record i goes into its slot only after
+// head_ reached i, so a reader that copied a slot and then sees head_ at now
+// knows records up to now - Capacity may have been overwritten meanwhile,
+// record now included as it may be halfway written. Slots are relaxed atomic
+// words, so the copy is no data race even when it is thrown away
+template <std::size_t Capacity>
+class fsm_trace_ring {
+    static_assert(std::has_single_bit(Capacity), "Capacity must be a power of two");
+    static_assert(sizeof(fsm_trace_record) % sizeof(uint64_t) == 0);
+
+    static constexpr std::size_t words = sizeof(fsm_trace_record) / sizeof(uint64_t);
+
+    using slot = std::array<std::atomic<uint64_t>, words>;
+
+public:
+    explicit fsm_trace_ring(uint32_t thread) noexcept
+        : thread_(thread)
+    {
+    }
+
+    void push(fsm_trace_record record) noexcept
+    {
+        record.thread = thread_;
+        uint64_t bits[words];
+        std::memcpy(bits, &record, sizeof(record));
+
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        // Orders head_ reaching head before the slot writes, pairs with the fence in copy()
+        std::atomic_thread_fence(std::memory_order_release);
+        slot& target = slots_[head & (Capacity - 1)];
+        for (std::size_t w = 0; w < words; ++w) {
+            target[w].store(bits[w], std::memory_order_relaxed);
+        }
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    // Appends records pushed since the last clear(), oldest first. Records the
+    // owner overwrote during the copy are dropped again
+    void copy(std::vector<fsm_trace_record>& out) const
+    {
+        uint64_t head  = head_.load(std::memory_order_acquire);
+        uint64_t first = std::max(head - std::min<uint64_t>(head, Capacity), start_.load(std::memory_order_relaxed));
+        std::size_t at = out.size();
+        for (uint64_t i = first; i < head; ++i) {
+            const slot& source = slots_[i & (Capacity - 1)];
+            uint64_t bits[words];
+            for (std::size_t w = 0; w < words; ++w) {
+                bits[w] = source[w].load(std::memory_order_relaxed);
+            }
+            fsm_trace_record& record = out.emplace_back();
+            std::memcpy(&record, bits, sizeof(record));
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t now = head_.load(std::memory_order_relaxed);
+        // Oldest record that is surely intact, the one now is being written over is not
+        uint64_t intact = now + 1 - std::min<uint64_t>(now + 1, Capacity);
+        uint64_t torn   = std::min(intact - std::min(intact, first), head - first);
+        out.erase(out.begin() + at, out.begin() + at + torn);
+    }
+
+    void clear() noexcept
+    {
+        start_.store(head_.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+
+private:
+    std::array<slot, Capacity> slots_ {};
+    std::atomic<uint64_t> head_ { 0 };
+    std::atomic<uint64_t> start_ { 0 };
+    uint32_t thread_;
+};
+
+template <std::size_t Capacity = 4096>
+class fsm_ring_trace {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct timer {
+        clock::time_point start_;
+    };
+
+    timer start() const noexcept
+    {
+        return { clock::now() };
+    }
+
+    template <typename Machine, typename Event>
+    void on_dispatch(timer t, const Machine& machine, const Event&, std::size_t from, std::size_t to,
+        boost::msm::back::HandledEnum result, std::size_t deferred) const noexcept
+    {
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t.start_).count();
+        fsm_trace_record record;
+        record.time     = std::chrono::duration_cast<std::chrono::nanoseconds>(t.start_.time_since_epoch()).count();
+        record.machine  = &machine;
+        record.event    = &typeid(Event);
+        record.from     = &Machine::state_type(from);
+        record.to       = &Machine::state_type(to);
+        record.latency  = static_cast<uint32_t>(std::min<uint64_t>(ns, std::numeric_limits<uint32_t>::max()));
+        record.deferred = static_cast<uint32_t>(deferred);
+        record.result   = result;
+        local().push(record);
+    }
+
+    // Records of every thread that traced with this Capacity, by time. Threads that
+    // ended keep their records until the program does
+    static std::vector<fsm_trace_record> collect()
+    {
+        std::vector<fsm_trace_record> records;
+        for (const auto& ring : rings()) {
+            ring->copy(records);
+        }
+        std::stable_sort(records.begin(), records.end(),
+            [](const fsm_trace_record& a, const fsm_trace_record& b) { return a.time < b.time; });
+        return records;
+    }
+
+    // Forgets the records so far, threads go on tracing
+    static void clear()
+    {
+        for (const auto& ring : rings()) {
+            ring->clear();
+        }
+    }
+
+private:
+    using ring = fsm_trace_ring<Capacity>;
+
+    struct registry {
+        std::mutex mtx_;
+        std::vector<std::shared_ptr<ring>> rings_;
+    };
+
+    static registry& all() noexcept
+    {
+        static registry instance;
+        return instance;
+    }
+
+    static std::vector<std::shared_ptr<ring>> rings()
+    {
+        registry& r = all();
+        std::lock_guard lock { r.mtx_ };
+        return r.rings_;
+    }
+
+    // A thread registers its ring on the first record, later records take no lock
+    static ring& local()
+    {
+        thread_local std::shared_ptr<ring> mine = []() {
+            registry& r = all();
+            std::lock_guard lock { r.mtx_ };
+            r.rings_.push_back(std::make_shared<ring>(static_cast<uint32_t>(r.rings_.size())));
+            return r.rings_.back();
+        }();
+        return *mine;
+    }
+};
+
+// One line per record, times relative to the first one
+inline void fsm_trace_dump(std::ostream& out, std::span<const fsm_trace_record> records)
+{
+    auto result_name = [](boost::msm::back::HandledEnum result) {
+        switch (result) {
+        case boost::msm::back::HANDLED_TRUE:
+            return "handled";
+        case boost::msm::back::HANDLED_GUARD_REJECT:
+            return "guard rejected";
+        case boost::msm::back::HANDLED_DEFERRED:
+            return "deferred";
+        default:
+            return "no transition";
+        }
+    };
+
+    out << boost::format("%1$12s %2$6s %3$18s %4$-16s %5$-32s %6$-16s %7$10s %8$8s\n") % "time_ns" % "thread"
+            % "machine" % "event" % "transition" % "result" % "latency_ns" % "deferred";
+    uint64_t origin = records.empty() ? 0 : records.front().time;
+    for (const fsm_trace_record& record : records) {
+        std::string transition = boost::core::demangle(record.from->name()) + " -> "
+            + boost::core::demangle(record.to->name());
+        out << boost::format("%1$12d %2$6d %3$18p %4$-16s %5$-32s %6$-16s %7$10d %8$8d\n") % (record.time - origin)
+                % record.thread % record.machine % boost::core::demangle(record.event->name()) % transition
+                % result_name(record.result) % record.latency % record.deferred;
+    }
+}
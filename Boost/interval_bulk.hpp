@@ -0,0 +1,213 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <latch>
+#include <limits>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
+#include <boost/icl/discrete_interval.hpp>
+
+// Bulk building of interval maps from a batch of (interval, ids) pairs.
+//
+// Instead of adding pairs one at a time, which splits segments and merges
+// id sets on every step, starts and ends are sorted once and swept in order.
+// The sweep yields every elementary segment with its final id set exactly
+// once, adjacent segments with equal sets already merged. Sorting is the
+// only O(n log n) part, so it can run on a thread pool.
+
+// Interval with closed bounds and the id it carries
+template <typename Domain, typename Id>
+struct closed_interval {
+    Domain first_;
+    Domain last_;
+    Id id_;
+};
+
+// Runs task(0) ... task(count - 1) on the pool and waits for all of them.
+// Must not be called from a task of the same pool, it would wait on itself
+template <typename Task>
+void run_on_pool(boost::asio::thread_pool& pool, std::size_t count, Task&& task)
+{
+    std::latch done { static_cast<std::ptrdiff_t>(count) };
+    for (std::size_t i = 0; i < count; ++i) {
+        boost::asio::post(pool, [&task, &done, i]() {
+            task(i);
+            done.count_down();
+        });
+    }
+    done.wait();
+}
+
+// Sorts tasks chunks on the pool, then merges neighbouring runs pairwise in
+// rounds, every merge of a round on the pool too. Comparison must not throw
+template <typename RandomIt, typename Compare>
+void parallel_sort(RandomIt first, RandomIt last, Compare comp, boost::asio::thread_pool& pool, std::size_t tasks)
+{
+    // Below this a chunk sorts faster than the pool hands it out
+    static constexpr std::size_t min_chunk = 1 << 14;
+
+    std::size_t size = last - first;
+    tasks            = std::min(tasks, size / min_chunk);
+    if (tasks < 2) {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    std::vector<std::size_t> bounds(tasks + 1);
+    for (std::size_t i = 0; i <= tasks; ++i) {
+        bounds[i] = size * i / tasks;
+    }
+    run_on_pool(pool, tasks, [&](std::size_t i) { std::sort(first + bounds[i], first + bounds[i + 1], comp); });
+
+    for (std::size_t width = 1; width < tasks; width *= 2) {
+        std::size_t merges = (tasks + 2 * width - 1) / (2 * width);
+        run_on_pool(pool, merges, [&](std::size_t i) {
+            std::size_t low  = 2 * width * i;
+            std::size_t mid  = std::min(low + width, tasks);
+            std::size_t high = std::min(low + 2 * width, tasks);
+            std::inplace_merge(first + bounds[low], first + bounds[mid], first + bounds[high], comp);
+        });
+    }
+}
+
+// Sorts with std::sort, or with parallel_sort() when given a pool
+class interval_sorter {
+public:
+    interval_sorter()
+        : pool_(nullptr)
+        , tasks_(1)
+    {
+    }
+
+    explicit interval_sorter(boost::asio::thread_pool& pool, std::size_t tasks = std::thread::hardware_concurrency())
+        : pool_(&pool)
+        , tasks_(tasks)
+    {
+    }
+
+    template <typename RandomIt, typename Compare>
+    void operator()(RandomIt first, RandomIt last, Compare comp) const
+    {
+        if (pool_ == nullptr) {
+            std::sort(first, last, comp);
+        } else {
+            parallel_sort(first, last, comp, *pool_, tasks_);
+        }
+    }
+
+private:
+    boost::asio::thread_pool* pool_;
+    std::size_t tasks_;
+};
+
+// Cuts the domain at every start and one past every end and calls emit(bound, ids)
+// in ascending order of bounds whenever the set of covering ids changes. ids are
+// sorted and unique and empty for a gap, the segment lasts until the next bound or
+// to the end of the domain. An id coming with overlapping intervals is listed once
+template <typename Domain, typename Id, typename Emit>
+void sweep_intervals(std::vector<closed_interval<Domain, Id>>& by_first, const interval_sorter& sort, Emit&& emit)
+{
+    using closed = closed_interval<Domain, Id>;
+
+    std::vector<closed> by_last(by_first);
+    sort(by_first.begin(), by_first.end(), [](const closed& a, const closed& b) { return a.first_ < b.first_; });
+    sort(by_last.begin(), by_last.end(), [](const closed& a, const closed& b) { return a.last_ < b.last_; });
+
+    boost::container::flat_map<Id, std::size_t> active;
+    std::vector<Id> previous;
+    std::vector<Id> current;
+    auto add_first = by_first.begin();
+    auto add_last  = by_last.begin();
+    while (true) {
+        // Intervals ending at the largest point have nothing after them to cut, they come last in by_last
+        bool has_first = add_first != by_first.end();
+        bool has_last  = add_last != by_last.end() && add_last->last_ != std::numeric_limits<Domain>::max();
+        if (!has_first && !has_last) {
+            break;
+        }
+        // Next bound is the closest start or one past the closest end
+        Domain bound = !has_last || (has_first && add_first->first_ <= add_last->last_) ? add_first->first_
+                                                                                        : add_last->last_ + 1;
+
+        for (; add_last != by_last.end() && add_last->last_ < bound; ++add_last) {
+            auto it = active.find(add_last->id_);
+            if (--it->second == 0) {
+                active.erase(it);
+            }
+        }
+        for (; add_first != by_first.end() && add_first->first_ == bound; ++add_first) {
+            ++active[add_first->id_];
+        }
+
+        current.clear();
+        for (const auto& [id, count] : active) {
+            current.push_back(id);
+        }
+        if (current != previous) {
+            emit(bound, std::span<const Id>(current));
+            previous.swap(current);
+        }
+    }
+}
+
+// Builds the same map as adding every pair with +=, segments are appended in
+// order, so every set is allocated once. Map is a boost::icl::interval_map of
+// discrete intervals with a set of ids as codomain
+template <typename Map, typename Set>
+Map make_interval_map(std::span<const std::pair<typename Map::interval_type, Set>> entries,
+    const interval_sorter& sort = interval_sorter())
+{
+    using domain   = typename Map::domain_type;
+    using id       = typename Set::value_type;
+    using interval = typename Map::interval_type;
+
+    std::vector<closed_interval<domain, id>> spans;
+    spans.reserve(entries.size());
+    for (const auto& [in, ids] : entries) {
+        if (boost::icl::is_empty(in)) {
+            continue;
+        }
+        for (const id& i : ids) {
+            spans.push_back({ boost::icl::first(in), boost::icl::last(in), i });
+        }
+    }
+
+    Map map;
+    auto hint = map.end();
+    domain pending_bound {};
+    std::vector<id> pending;
+    // Ends the pending segment right before bound, or at bound for the last one. Nothing is
+    // pending before the first bound, which may be the lowest value of a signed domain
+    auto flush = [&](domain bound, bool inclusive) {
+        if (pending.empty()) {
+            return;
+        }
+        domain last = inclusive ? bound : bound - 1;
+        Set set;
+        if constexpr (requires { Set(boost::container::ordered_unique_range, pending.begin(), pending.end()); }) {
+            set = Set(boost::container::ordered_unique_range, pending.begin(), pending.end());
+        } else {
+            set = Set(pending.begin(), pending.end());
+        }
+        // Segments are disjoint and ascending, so insert only appends after the hint
+        hint = map.insert(hint, std::make_pair(interval::closed(pending_bound, last), std::move(set)));
+    };
+
+    sweep_intervals(spans, sort, [&](domain bound, std::span<const id> ids) {
+        flush(bound, false);
+        pending_bound = bound;
+        pending.assign(ids.begin(), ids.end());
+    });
+    flush(std::numeric_limits<domain>::max(), true);
+    return map;
+}
@@ -0,0 +1,398 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/container/vector.hpp>
+#include <boost/icl/discrete_interval.hpp>
+
+#include "interval_bulk.hpp"
+
+// Read only replacement for boost::icl::interval_map<Domain, flat_set<Id>> built
+// once from a batch of (interval, id) pairs.
+//
+// The sweep from interval_bulk.hpp cuts the domain into elementary segments at
+// every interval start and end and merges adjacent segments covered by the same
+// ids, exactly like interval_map does. Everything lives in flat sorted arrays in
+// CSR form:
+//
+//  * bounds_, first point of every segment, gaps without ids are segments too
+//  * ids_ from offsets_[s] to offsets_[s + 1], sorted ids covering segment s
+//  * starts_ from start_offsets_[s] to start_offsets_[s + 1], ids of segment s
+//    missing from segment s - 1, so a range query reports every id once
+//
+// A point query is a branchless binary search over bounds_ followed by a linear
+// scan of one ids_ run, neither allocates nor follows a pointer. A batch of point
+// or range queries is answered in one galloping sweep over bounds_ in ascending
+// order, unsorted batches are radix sorted first.
+template <typename Domain = uint32_t, typename Id = uint32_t>
+class interval_index {
+public:
+    using domain_type = Domain;
+    using id_type     = Id;
+    using interval    = boost::icl::discrete_interval<Domain>;
+    using entry       = std::pair<interval, Id>;
+
+    // Whether a batch of queries comes sorted, by point or by first point of a range
+    enum class batch_order {
+        sorted,
+        // Sorted internally, results still come in input order
+        unsorted,
+    };
+
+    // Caller owned results of a batch of queries, ids of query i are batch[i]. Reused
+    // between batches it keeps its capacity, so steady state queries do not allocate
+    class batch {
+    public:
+        batch()
+            : offsets_(1, 0)
+        {
+        }
+
+        std::size_t size() const noexcept
+        {
+            return offsets_.size() - 1;
+        }
+
+        std::span<const Id> operator[](std::size_t query) const noexcept
+        {
+            return std::span<const Id>(ids_.data() + offsets_[query], offsets_[query + 1] - offsets_[query]);
+        }
+
+    private:
+        friend class interval_index;
+
+        using key = std::pair<Domain, std::size_t>;
+
+        boost::container::vector<std::size_t> offsets_;
+        boost::container::vector<Id> ids_;
+        // Segments every query starts and ends in, in input order, no_segment as last when it finds nothing
+        boost::container::vector<std::size_t> firsts_;
+        boost::container::vector<std::size_t> lasts_;
+        // Keys and positions of an unsorted batch, scratch_ is the other half of the radix sort
+        boost::container::vector<key> order_;
+        boost::container::vector<key> scratch_;
+    };
+
+private:
+    using offset  = uint32_t;
+    using domains = boost::container::vector<Domain>;
+    using ids     = boost::container::vector<Id>;
+    using offsets = boost::container::vector<offset>;
+
+    static constexpr std::size_t no_segment = std::numeric_limits<std::size_t>::max();
+
+    using closed = closed_interval<Domain, Id>;
+
+    domains bounds_;
+    offsets offsets_;
+    ids ids_;
+    offsets start_offsets_;
+    ids starts_;
+    std::size_t size_;
+
+    // Segments come from the sweep already merged, only the new ids have to be found
+    void push_segment(Domain bound, std::span<const Id> segment_ids)
+    {
+        // New starts are a subset of the segment ids, so this bounds both arrays
+        if (std::max(ids_.size(), starts_.size()) + segment_ids.size() > std::numeric_limits<offset>::max()) {
+            throw std::length_error("interval_index: too many ids over all segments");
+        }
+        std::size_t previous = bounds_.size();
+        bounds_.push_back(bound);
+        ids_.insert(ids_.end(), segment_ids.begin(), segment_ids.end());
+        offsets_.push_back(static_cast<offset>(ids_.size()));
+
+        if (previous == 0) {
+            starts_.insert(starts_.end(), segment_ids.begin(), segment_ids.end());
+        } else {
+            std::set_difference(segment_ids.begin(), segment_ids.end(), ids_.begin() + offsets_[previous - 1],
+                ids_.begin() + offsets_[previous], std::back_inserter(starts_));
+        }
+        start_offsets_.push_back(static_cast<offset>(starts_.size()));
+    }
+
+    // Last segment starting at or before point. The loop has a fixed trip count
+    // for a given size and the step compiles to a conditional move
+    std::size_t segment_of(Domain point) const noexcept
+    {
+        if (bounds_.empty() || point < bounds_.front()) {
+            return no_segment;
+        }
+
+        const Domain* base = bounds_.data();
+        std::size_t count  = bounds_.size();
+        while (count > 1) {
+            std::size_t half = count / 2;
+            base             = base[half] <= point ? base + half : base;
+            count -= half;
+        }
+        return base - bounds_.data();
+    }
+
+    // segment_of(point) for a point not below the one segment was found for. Gallops
+    // from there, so ascending points cost one pass over bounds_ in total, and only
+    // a logarithm of the distance when they are far apart
+    std::size_t segment_after(std::size_t segment, Domain point) const noexcept
+    {
+        if (segment == no_segment) {
+            if (bounds_.empty() || point < bounds_.front()) {
+                return no_segment;
+            }
+            segment = 0;
+        }
+        std::size_t step = 1;
+        while (segment + step < bounds_.size() && bounds_[segment + step] <= point) {
+            segment += step;
+            step *= 2;
+        }
+        auto end = bounds_.begin() + std::min(segment + step, bounds_.size());
+        return std::upper_bound(bounds_.begin() + segment + 1, end, point) - bounds_.begin() - 1;
+    }
+
+    // Calls locate(query, segment) in ascending order of key(query), segment being
+    // what the previous call returned, and expects the segment of the key back
+    template <typename Key, typename Locate>
+    void sweep_batch(std::size_t queries, batch_order order, batch& out, Key&& key, Locate&& locate) const
+    {
+        std::size_t segment = no_segment;
+        if (order == batch_order::sorted) {
+            for (std::size_t query = 0; query < queries; ++query) {
+                segment = locate(query, segment);
+            }
+            return;
+        }
+        out.order_.clear();
+        for (std::size_t query = 0; query < queries; ++query) {
+            out.order_.emplace_back(key(query), query);
+        }
+        sort_keys(out.order_, out.scratch_);
+        for (const auto& [point, query] : out.order_) {
+            segment = locate(query, segment);
+        }
+    }
+
+    // LSD radix sort by a byte per pass, skipping bytes all keys share. Cheaper than
+    // comparison sorts by enough to pay for itself against a binary search per key
+    template <typename Key>
+    static void sort_keys(boost::container::vector<Key>& keys, boost::container::vector<Key>& scratch)
+    {
+        if constexpr (!std::is_unsigned_v<Domain>) {
+            std::sort(keys.begin(), keys.end());
+        } else {
+            if (keys.size() < 2) {
+                return;
+            }
+            scratch.resize(keys.size());
+            for (std::size_t shift = 0; shift < std::numeric_limits<Domain>::digits; shift += 8) {
+                std::array<std::size_t, 256> counts {};
+                for (const Key& key : keys) {
+                    ++counts[(key.first >> shift) & 0xff];
+                }
+                if (counts[(keys.front().first >> shift) & 0xff] == keys.size()) {
+                    continue;
+                }
+                std::size_t sum = 0;
+                for (std::size_t& count : counts) {
+                    sum += std::exchange(count, sum);
+                }
+                for (const Key& key : keys) {
+                    scratch[counts[(key.first >> shift) & 0xff]++] = key;
+                }
+                keys.swap(scratch);
+            }
+        }
+    }
+
+    // Copies the ids found for every query into out: the ids of its first segment and
+    // the ids starting in the segments after it up to its last, both contiguous runs
+    void gather(batch& out) const
+    {
+        std::size_t queries = out.firsts_.size();
+        out.offsets_.resize(queries + 1);
+        std::size_t total = 0;
+        for (std::size_t query = 0; query < queries; ++query) {
+            out.offsets_[query] = total;
+            std::size_t first   = out.firsts_[query];
+            std::size_t last    = out.lasts_[query];
+            if (last != no_segment) {
+                total += offsets_[first + 1] - offsets_[first] + start_offsets_[last + 1] - start_offsets_[first + 1];
+            }
+        }
+        out.offsets_[queries] = total;
+
+        out.ids_.resize(total, boost::container::default_init);
+        Id* to = out.ids_.data();
+        for (std::size_t query = 0; query < queries; ++query) {
+            std::size_t first = out.firsts_[query];
+            std::size_t last  = out.lasts_[query];
+            if (last != no_segment) {
+                auto starts = starts_.begin();
+                to          = std::copy(ids_.begin() + offsets_[first], ids_.begin() + offsets_[first + 1], to);
+                to          = std::copy(starts + start_offsets_[first + 1], starts + start_offsets_[last + 1], to);
+            }
+        }
+    }
+
+    template <typename Visit>
+    void visit_ids(std::size_t segment, Visit& visit) const
+    {
+        for (offset i = offsets_[segment]; i < offsets_[segment + 1]; ++i) {
+            visit(ids_[i]);
+        }
+    }
+
+    template <typename Visit>
+    void visit_starts(std::size_t segment, Visit& visit) const
+    {
+        for (offset i = start_offsets_[segment]; i < start_offsets_[segment + 1]; ++i) {
+            visit(starts_[i]);
+        }
+    }
+
+public:
+    interval_index()
+        : bounds_()
+        , offsets_(1, 0)
+        , ids_()
+        , start_offsets_(1, 0)
+        , starts_()
+        , size_(0)
+    {
+    }
+
+    // Empty intervals are skipped, the same id may come with several intervals.
+    // With a pool sorter the endpoints are sorted in parallel, see interval_bulk.hpp.
+    // Offsets are 32 bits, std::length_error is thrown when the ids of all
+    // segments together do not fit
+    explicit interval_index(std::span<const entry> entries, const interval_sorter& sort = interval_sorter())
+        : interval_index()
+    {
+        std::vector<closed> spans;
+        spans.reserve(entries.size());
+        for (const auto& [in, id] : entries) {
+            if (!boost::icl::is_empty(in)) {
+                spans.push_back({ boost::icl::first(in), boost::icl::last(in), id });
+            }
+        }
+        size_ = spans.size();
+
+        sweep_intervals(spans, sort, [this](Domain bound, std::span<const Id> segment_ids) {
+            push_segment(bound, segment_ids);
+        });
+    }
+
+    // Number of non empty intervals the index was built from
+    std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    bool empty() const noexcept
+    {
+        return size_ == 0;
+    }
+
+    // Elementary segments, including gaps covered by no id
+    std::size_t segment_count() const noexcept
+    {
+        return bounds_.size();
+    }
+
+    // Calls visit(id) for every id whose interval contains point, in ascending order
+    template <typename Visit>
+    void stab(Domain point, Visit&& visit) const
+    {
+        std::size_t segment = segment_of(point);
+        if (segment != no_segment) {
+            visit_ids(segment, visit);
+        }
+    }
+
+    // Calls visit(id) for every id whose interval overlaps range. An id is reported once
+    // for every separate stretch of the range it covers, so exactly once when ids are unique
+    template <typename Visit>
+    void stab(const interval& range, Visit&& visit) const
+    {
+        if (boost::icl::is_empty(range) || bounds_.empty()) {
+            return;
+        }
+        Domain first = boost::icl::first(range);
+        Domain last  = boost::icl::last(range);
+
+        std::size_t end = segment_of(last);
+        if (end == no_segment) {
+            return;
+        }
+        std::size_t begin = segment_of(first);
+        begin             = begin == no_segment ? 0 : begin;
+        visit_ids(begin, visit);
+        for (std::size_t segment = begin + 1; segment <= end; ++segment) {
+            visit_starts(segment, visit);
+        }
+    }
+
+    // stab(point) for a whole batch in one sweep over the segments instead of a
+    // search per point. Results replace what out held before
+    void stab(std::span<const Domain> points, batch& out, batch_order order = batch_order::sorted) const
+    {
+        out.firsts_.resize(points.size());
+        out.lasts_.resize(points.size());
+        sweep_batch(
+            points.size(), order, out, [points](std::size_t query) { return points[query]; },
+            [this, points, &out](std::size_t query, std::size_t segment) {
+                segment            = segment_after(segment, points[query]);
+                out.firsts_[query] = segment;
+                out.lasts_[query]  = segment;
+                return segment;
+            });
+        gather(out);
+    }
+
+    // stab(range) for a whole batch, ranges are ordered by their first points
+    void stab(std::span<const interval> ranges, batch& out, batch_order order = batch_order::sorted) const
+    {
+        out.firsts_.resize(ranges.size());
+        out.lasts_.resize(ranges.size());
+        sweep_batch(
+            ranges.size(), order, out, [ranges](std::size_t query) { return boost::icl::first(ranges[query]); },
+            [this, ranges, &out](std::size_t query, std::size_t segment) {
+                const interval& range = ranges[query];
+                if (boost::icl::is_empty(range)) {
+                    out.lasts_[query] = no_segment;
+                    return segment;
+                }
+                segment            = segment_after(segment, boost::icl::first(range));
+                out.firsts_[query] = segment == no_segment ? 0 : segment;
+                out.lasts_[query]  = segment_after(segment, boost::icl::last(range));
+                return segment;
+            });
+        gather(out);
+    }
+
+    // Calls visit(first, last, ids) for every segment covered by at least one id, in
+    // domain order, with closed bounds. The same segments interval_map would hold
+    template <typename Visit>
+    void for_each_segment(Visit&& visit) const
+    {
+        for (std::size_t segment = 0; segment < bounds_.size(); ++segment) {
+            if (offsets_[segment] == offsets_[segment + 1]) {
+                continue;
+            }
+            Domain last = segment + 1 < bounds_.size() ? bounds_[segment + 1] - 1 : std::numeric_limits<Domain>::max();
+            visit(bounds_[segment], last,
+                std::span<const Id>(ids_.data() + offsets_[segment], offsets_[segment + 1] - offsets_[segment]));
+        }
+    }
+};
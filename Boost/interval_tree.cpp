@@ -1,23 +1,34 @@
 // Copyright 2024 Severin Denisenko
 
+#include <boost/asio/thread_pool.hpp>
 #include <boost/container/flat_set.hpp>
 #include <boost/icl/interval_map.hpp>
 #include <fmt/format.h>
 
 #include <cstdint>
 #include <iostream>
+#include <span>
+#include <vector>
+
+#include "interval_bulk.hpp"
+#include "interval_index.hpp"
+#include "roaring_set.hpp"
 
 using number_t       = uint32_t;
 using set_t          = boost::container::flat_set<number_t>;
 using interval_map_t = boost::icl::interval_map<number_t, set_t>;
 using interval_t     = boost::icl::discrete_interval<number_t>;
+using segment_t      = std::pair<interval_t, set_t>;
+using index_t        = interval_index<number_t, number_t>;
+using roaring_map_t  = boost::icl::interval_map<number_t, roaring_set>;
 
 void print()
 {
     std::cout << std::endl;
 }
 
-void print(interval_map_t& map)
+template <typename Map>
+void print(const Map& map)
 {
     for (auto& [interval, set] : map) {
         std::cout << fmt::format("({}: {}): ", interval.lower(), interval.upper());
@@ -28,6 +39,17 @@ void print(interval_map_t& map)
     }
 }
 
+void print(const index_t& index)
+{
+    index.for_each_segment([](number_t first, number_t last, std::span<const number_t> ids) {
+        std::cout << fmt::format("[{}: {}]: ", first, last);
+        for (number_t id : ids) {
+            std::cout << fmt::format("{} ", id);
+        }
+        std::cout << std::endl;
+    });
+}
+
 int main()
 {
     interval_map_t map;
@@ -38,6 +60,59 @@ int main()
 
     print(map);
 
+    // Same map from one sweep over endpoints sorted on a thread pool
+    std::vector<segment_t> segments {
+        { interval_t::open(0, 10), set_t { 0 } },
+        { interval_t::open(5, 10), set_t { 1 } },
+        { interval_t::open(0, 5), set_t { 2 } },
+        { interval_t::open(3, 7), set_t { 3 } },
+    };
+    boost::asio::thread_pool pool(2);
+    interval_map_t bulk = make_interval_map<interval_map_t, set_t>(segments, interval_sorter(pool));
+    pool.join();
+
+    print();
+    print(bulk);
+    std::cout << fmt::format("same as incremental: {}\n", bulk == map);
+
+    // Compressed id sets, segments split off the same set share its storage
+    roaring_map_t roaring;
+    roaring += std::make_pair(interval_t::open(0, 10), roaring_set { 0 });
+    roaring += std::make_pair(interval_t::open(5, 10), roaring_set { 1 });
+    roaring += std::make_pair(interval_t::open(0, 5), roaring_set { 2 });
+    roaring += std::make_pair(interval_t::open(3, 7), roaring_set { 3 });
+
+    print();
+    print(roaring);
+
+    // Same segments from flat arrays, built once and only read afterwards
+    std::vector<index_t::entry> entries {
+        { interval_t::open(0, 10), 0 },
+        { interval_t::open(5, 10), 1 },
+        { interval_t::open(0, 5), 2 },
+        { interval_t::open(3, 7), 3 },
+    };
+    index_t index { entries };
+
+    print();
+    print(index);
+
+    std::cout << "6 is in:";
+    index.stab(6, [](number_t id) { std::cout << fmt::format(" {}", id); });
+    std::cout << std::endl;
+
+    // Many points in one sweep, the index sorts them and answers in input order
+    std::vector<number_t> points { 9, 1, 6, 4 };
+    index_t::batch found;
+    index.stab(points, found, index_t::batch_order::unsorted);
+    for (std::size_t i = 0; i < points.size(); ++i) {
+        std::cout << fmt::format("{} is in:", points[i]);
+        for (number_t id : found[i]) {
+            std::cout << fmt::format(" {}", id);
+        }
+        std::cout << std::endl;
+    }
+
     map -= std::make_pair(interval_t::open(0, 5), set_t { 0 });
     map -= std::make_pair(interval_t::open(5, 10), set_t { 3 });
 
@@ -1,13 +1,19 @@
 // Copyright 2024 Severin Denisenko
 
+#include <chrono>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #include <fmt/format.h>
 
 #include "lru_map.hpp"
+#include "lru_snapshot.hpp"
 
-template <typename T, typename U>
-void print(lru_map<T, U>& map)
+template <typename Map>
+void print(Map& map)
 {
     for (const auto& val : map) {
         std::cout << fmt::format("({},  {}) ", val.get_key(), val.get_value());
@@ -15,6 +21,14 @@ void print(lru_map<T, U>& map)
     std::cout << std::endl;
 }
 
+// Weight of an entry is the length of its value
+struct length_weigher {
+    std::size_t operator()(int, const std::string& value) const noexcept
+    {
+        return value.size();
+    }
+};
+
 int main()
 {
     lru_map<int, int> map { 3 };
@@ -35,5 +49,67 @@ int main()
 
     print(map);
 
+    map.get_or_compute(5, []() { return 5; });
+    map.get(3) = 33;
+    map.erase(4);
+
+    print(map);
+
+    // 6 is gone after 10ms, found by the lookup before expire() gets to it
+    map.put(6, 6, std::chrono::milliseconds(10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::cout << fmt::format("6 is {}\n", map.contains(6) ? "alive" : "expired");
+
+    map.put(7, 7, std::chrono::milliseconds(10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::cout << fmt::format("expire() evicted {}\n", map.expire());
+
+    print(map);
+
+    // Shrinking keeps the most recently used entries
+    map.resize(1);
+
+    print(map);
+
+    // Budget of 8 characters, about 4 entries expected
+    lru_map<int, std::string, std::hash<int>, std::equal_to<int>, lru_node_pool, lru_policy, length_weigher> strings {
+        8, 4
+    };
+
+    strings.put(1, "aaaa");
+    strings.put(2, "bb");
+    strings.put(3, "cccccc");
+
+    print(strings);
+    std::cout << fmt::format("weight {} of {}\n", strings.weight(), strings.max_weight());
+
+    // Warm restart: lookups are served straight from the mapped file while the map is rebuilt from it
+    lru_save(strings, "strings.snap");
+    {
+        decltype(strings)::snapshot<> snapshot { "strings.snap" };
+        decltype(strings) restored { 8, 4 };
+
+        std::thread loader([&]() { lru_load(restored, snapshot); });
+        std::cout << fmt::format("3 from snapshot is {}\n", snapshot.get(3).value_or("missing"));
+        loader.join();
+
+        print(restored);
+    }
+
+    // Batched lookup overlaps the cache misses of all keys
+    std::vector<int> keys { 1, 2, 3 };
+    std::vector<std::string*> found(keys.size());
+    std::cout << fmt::format("{} of {} keys found\n", strings.get_many(keys, found), keys.size());
+
+    lru_map<int, int, std::hash<int>, std::equal_to<int>, lru_node_pool, lru_policy, lru_unit_weigher, lru_stats>
+        counted { 100 };
+    for (int i = 0; i < 1000; ++i) {
+        counted.put(i % 150, int { i });
+        counted.contains(i % 120);
+    }
+
+    counted.stats().for_each_metric(
+        [](std::string_view name, double value) { std::cout << fmt::format("lru_map_{} {}\n", name, value); });
+
     return 0;
 }
@@ -2,7 +2,14 @@
 
 #pragma once
 
-#include <memory>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 #include <boost/intrusive/link_mode.hpp>
 #include <boost/intrusive/list.hpp>
@@ -13,12 +20,49 @@
 
 #include <boost/container/vector.hpp>
 
-template <typename Key, typename Value, typename Hash = std::hash<Key>, typename Equal = std::equal_to<Key>>
+#include "lru_node_pool.hpp"
+#include "lru_policies.hpp"
+#include "lru_stats.hpp"
+#include "lru_timer_wheel.hpp"
+
+// Snapshots are only named here, lru_snapshot.hpp brings file mapping along
+template <typename T>
+struct lru_serializer;
+
+template <typename Key, typename Value, typename Hash, typename Equal, typename KeySerializer,
+    typename ValueSerializer>
+class lru_snapshot;
+
+// Every entry weighs 1, so the weight budget is an entry count
+struct lru_unit_weigher {
+    template <typename Key, typename Value>
+    std::size_t operator()(const Key&, const Value&) const noexcept
+    {
+        return 1;
+    }
+};
+
+template <
+    typename Key,
+    typename Value,
+    typename Hash                      = std::hash<Key>,
+    typename Equal                     = std::equal_to<Key>,
+    template <typename> typename Alloc = lru_node_pool,
+    typename Policy                    = lru_policy,
+    typename Weigher                   = lru_unit_weigher,
+    typename Stats                     = lru_no_stats>
 class lru_map {
 public:
+    using key_type    = Key;
+    using mapped_type = Value;
+
+    using clock = std::chrono::steady_clock;
+
+    static constexpr clock::time_point no_deadline = clock::time_point::max();
+
     using link_mode = boost::intrusive::link_mode<
 #ifdef NDEBUG
-        boost::inintrusive::normal_link
+        boost::intrusive::normal_link
 #else
         boost::intrusive::safe_link
 #endif
@@ -27,11 +71,14 @@ public:
     using lru_list_hook     = boost::intrusive::list_base_hook<link_mode>;
     using lru_hash_set_hook = boost::intrusive::unordered_set_base_hook<link_mode>;
 
-    class lru_node final : public lru_list_hook, public lru_hash_set_hook {
+    class lru_node final : public lru_list_hook, public lru_hash_set_hook, public lru_timer_hook {
     public:
-        explicit lru_node(Key key, Value&& value)
+        template <typename... Args>
+        explicit lru_node(Key key, Args&&... args)
             : key_(std::move(key))
-            , value_(std::move(value))
+            , value_(std::forward<Args>(args)...)
+            , deadline_(no_deadline)
+            , weight_(0)
         {
         }
 
@@ -45,6 +92,11 @@ public:
             return value_;
         }
 
+        Value& get_value() noexcept
+        {
+            return value_;
+        }
+
         void set_value(Value&& value)
         {
             value_ = std::move(value);
@@ -55,13 +107,47 @@ public:
             key_ = std::move(key);
         }
 
+        Policy::node_data& policy_data() noexcept
+        {
+            return policy_data_;
+        }
+
+        clock::time_point deadline() const noexcept
+        {
+            return deadline_;
+        }
+
+        void set_deadline(clock::time_point deadline) noexcept
+        {
+            deadline_ = deadline;
+        }
+
+        bool expired(clock::time_point now) const noexcept
+        {
+            return deadline_ <= now;
+        }
+
+        std::size_t weight() const noexcept
+        {
+            return weight_;
+        }
+
+        void set_weight(std::size_t weight) noexcept
+        {
+            weight_ = weight;
+        }
+
     private:
         Key key_;
         Value value_;
+        clock::time_point deadline_;
+        std::size_t weight_;
+        [[no_unique_address]] Policy::node_data policy_data_;
     };
 
     struct lru_node_hash : Hash {
-        auto operator()(const Key& a) const
+        template <typename K>
+        auto operator()(const K& a) const
         {
             return Hash::operator()(a);
         }
@@ -78,12 +164,14 @@ public:
             return Equal::operator()(a.get_key(), b.get_key());
         }
 
-        auto operator()(const Key& a, const lru_node& b) const
+        template <typename K>
+        auto operator()(const K& a, const lru_node& b) const
         {
             return Equal::operator()(a, b.get_key());
         }
 
-        auto operator()(const lru_node& a, const Key& b) const
+        template <typename K>
+        auto operator()(const lru_node& a, const K& b) const
         {
             return Equal::operator()(a.get_key(), b);
         }
@@ -94,87 +182,579 @@ public:
         }
     };
 
+    // Hash and Equal accept types other than Key, like std::string_view for std::string
+    static constexpr bool is_transparent = requires {
+        typename Hash::is_transparent;
+        typename Equal::is_transparent;
+    };
+
+    // Without transparent Hash and Equal the key is converted before lookup, like before
+    template <typename K>
+    static decltype(auto) lookup_key(const K& key)
+    {
+        if constexpr (is_transparent || std::is_same_v<K, Key>) {
+            return (key);
+        } else {
+            return Key(key);
+        }
+    }
+
+    // Incremental hashing splits or merges one bucket at a time, so the table
+    // follows the live size without a full rehash on any single call
     using map = boost::intrusive::unordered_set<lru_node, boost::intrusive::constant_time_size<true>,
-        boost::intrusive::hash<lru_node_hash>, boost::intrusive::equal<lru_node_equal>>;
+        boost::intrusive::hash<lru_node_hash>, boost::intrusive::equal<lru_node_equal>,
+        boost::intrusive::power_2_buckets<true>, boost::intrusive::incremental<true>>;
+
+    // Buckets in use, the array is twice as long, an incremental table starts half split
+    static constexpr std::size_t min_buckets = 8;
 
     using bucket_traits = map::bucket_traits;
     using bucket        = map::bucket_type;
     using buckets       = boost::container::vector<bucket>;
 
-    using list = boost::intrusive::list<lru_node, boost::intrusive::constant_time_size<false>>;
+    using queues = Policy::template queues<lru_node>;
+
+    using allocator = Alloc<lru_node>;
+
+    using timer_wheel = lru_timer_wheel<lru_node, clock>;
+
+    // Feeds an already computed hash to the intrusive map
+    struct prehashed {
+        std::size_t hash_;
+
+        template <typename K>
+        std::size_t operator()(const K&) const noexcept
+        {
+            return hash_;
+        }
+    };
 
-    std::size_t max_size_;
+    std::size_t max_weight_;
+    std::size_t weight_;
+    [[no_unique_address]] Weigher weigher_;
+    allocator allocator_;
     buckets buckets_;
-    bucket_traits bucket_traits_;
     map map_;
-    list list_;
+    queues queues_;
+    timer_wheel timers_;
+    [[no_unique_address]] Stats stats_;
 
-    std::unique_ptr<lru_node> extract_node(typename list::iterator it) noexcept
+    // An insert erases without shrinking, the node it adds would only grow the table back
+    void erase_node(lru_node& node, bool shrink = true)
     {
-        std::unique_ptr<lru_node> ret(&*it);
-        map_.erase(map_.iterator_to(*it));
-        list_.erase(it);
-        return ret;
+        map_.erase(map_.iterator_to(node));
+        queues_.on_erase(node);
+        timers_.cancel(node);
+        weight_ -= node.weight();
+        allocator_.deallocate(&node);
+        if (shrink) {
+            shrink_buckets();
+        }
+    }
+
+    // Evicts until node fits the budget. Boost.Intrusive allows no erase between
+    // insert_check() and insert_commit(), so the check is redone after evicting
+    void evict_for(const lru_node& node, std::size_t key_hash, typename map::insert_commit_data& commit_data)
+    {
+        bool evicted = false;
+        while (!map_.empty() && weight_ + node.weight() > max_weight_) {
+            erase_node(queues_.victim(map_.hash_function()), false);
+            stats_.on(lru_event::eviction);
+            evicted = true;
+        }
+        if (evicted) {
+            map_.insert_check(node.get_key(), prehashed { key_hash }, map_.key_eq(), commit_data);
+        }
+    }
+
+    // Keeps the load factor at most 1, the bucket array doubles once every bucket is split
+    void grow_buckets()
+    {
+        if (map_.size() <= map_.split_count()) {
+            return;
+        }
+        if (map_.split_count() == buckets_.size()) {
+            buckets bigger(buckets_.size() * 2);
+            map_.incremental_rehash(bucket_traits(bigger.data(), bigger.size()));
+            buckets_.swap(bigger);
+        }
+        map_.incremental_rehash(true);
+    }
+
+    // Merges back below load factor 1/4, the gap to grow_buckets() stops
+    // a size hovering at a boundary from splitting and merging the same bucket
+    void shrink_buckets()
+    {
+        if (map_.split_count() <= min_buckets || map_.size() * 4 >= map_.split_count()) {
+            return;
+        }
+        if (map_.split_count() == buckets_.size() / 2) {
+            buckets smaller(buckets_.size() / 2);
+            map_.incremental_rehash(bucket_traits(smaller.data(), smaller.size()));
+            buckets_.swap(smaller);
+        }
+        map_.incremental_rehash(false);
+    }
+
+    // Makes room for count more nodes up front, for loading them without per entry allocation or rehashing
+    void reserve(std::size_t count)
+    {
+        if constexpr (requires { allocator_.reserve(count); }) {
+            // The node built before its victims are chosen needs a slot too
+            std::size_t wanted = map_.size() + count + 1;
+            if (allocator_.capacity() < wanted) {
+                allocator_.reserve(wanted - allocator_.capacity());
+            }
+        }
+
+        // Full rehash leaves every bucket split, as if grow_buckets() had just doubled the array
+        std::size_t bucket_count = std::bit_ceil(std::max(map_.size() + count, min_buckets));
+        if (bucket_count > map_.split_count()) {
+            buckets bigger(bucket_count);
+            map_.rehash(bucket_traits(bigger.data(), bigger.size()));
+            buckets_.swap(bigger);
+        }
+    }
+
+    // The clock is read only for nodes that have a deadline at all
+    static bool stale(const lru_node& node) noexcept
+    {
+        return node.deadline() != no_deadline && node.expired(clock::now());
+    }
+
+    template <typename K>
+    std::size_t hash(const K& key) const
+    {
+        return map_.hash_function()(key);
+    }
+
+    // Bucket the intrusive map picks for a hash, with power of two buckets and incremental hashing
+    std::size_t bucket_of(std::size_t key_hash) const noexcept
+    {
+        std::size_t bucket = key_hash & (map_.bucket_count() - 1);
+        return bucket < map_.split_count() ? bucket : bucket - map_.bucket_count() / 2;
+    }
+
+    // Batches go in groups, every step issues the loads of the whole group before waiting on any of them:
+    // bucket heads first, then the first node of every chain, then the lookups themselves
+    static constexpr std::size_t batch_group = 16;
+
+    template <typename Resolve>
+    void for_each_group(std::span<const Key> keys, Resolve&& resolve)
+    {
+        std::size_t hashes[batch_group];
+        for (std::size_t first = 0; first < keys.size(); first += batch_group) {
+            std::size_t count = std::min(batch_group, keys.size() - first);
+            for (std::size_t i = 0; i < count; ++i) {
+                hashes[i] = hash(keys[first + i]);
+                __builtin_prefetch(&buckets_[bucket_of(hashes[i])]);
+            }
+            for (std::size_t i = 0; i < count; ++i) {
+                std::size_t bucket = bucket_of(hashes[i]);
+                auto it            = map_.begin(bucket);
+                if (it != map_.end(bucket)) {
+                    __builtin_prefetch(&*it);
+                    __builtin_prefetch(&it->get_key());
+                }
+            }
+            resolve(first, count, hashes);
+        }
+    }
+
+    // A replayed lookup was already counted when it happened, so it is not counted again
+    template <typename K>
+    lru_node* find_node(const K& key, bool replay = false)
+    {
+        std::size_t key_hash = hash(key);
+        queues_.on_access(key_hash);
+
+        auto it = map_.find(key, prehashed { key_hash }, map_.key_eq());
+        if (it == map_.end()) {
+            if (!replay) {
+                stats_.on(lru_event::miss);
+            }
+            return nullptr;
+        }
+        if (stale(*it)) {
+            erase_node(*it);
+            stats_.on(lru_event::expiration);
+            if (!replay) {
+                stats_.on(lru_event::miss);
+            }
+            return nullptr;
+        }
+
+        queues_.on_hit(*it);
+        if (!replay) {
+            stats_.on(lru_event::hit);
+        }
+        return &*it;
+    }
+
+    // Single probe insert, value is constructed in place only when key is missing or expired
+    template <typename K, typename... Args>
+    std::pair<lru_node*, bool> emplace_node(clock::time_point deadline, const K& key, Args&&... args)
+    {
+        decltype(auto) lookup = lookup_key(key);
+        std::size_t key_hash  = hash(lookup);
+        return emplace_hashed(key_hash, deadline, std::forward<decltype(lookup)>(lookup), std::forward<Args>(args)...);
+    }
+
+    template <typename K, typename... Args>
+    std::pair<lru_node*, bool> emplace_hashed(std::size_t key_hash, clock::time_point deadline, K&& lookup,
+        Args&&... args)
+    {
+        queues_.on_access(key_hash);
+
+        typename map::insert_commit_data commit_data;
+        auto [it, inserted] = map_.insert_check(lookup, prehashed { key_hash }, map_.key_eq(), commit_data);
+        if (!inserted && stale(*it)) {
+            erase_node(*it, false);
+            stats_.on(lru_event::expiration);
+            std::tie(it, inserted) = map_.insert_check(lookup, prehashed { key_hash }, map_.key_eq(), commit_data);
+        }
+        if (!inserted) {
+            queues_.on_hit(*it);
+            stats_.on(lru_event::hit);
+            return { &*it, false };
+        }
+        stats_.on(lru_event::miss);
+
+        // Node is built first, the weigher needs the value and a throwing constructor evicts nothing
+        lru_node* node = allocator_.allocate(Key(std::forward<K>(lookup)), std::forward<Args>(args)...);
+        node->set_weight(weigher_(node->get_key(), node->get_value()));
+        evict_for(*node, key_hash, commit_data);
+
+        map_.insert_commit(*node, commit_data);
+        weight_ += node->weight();
+        stats_.on(lru_event::insert);
+        // Evictions above left shrinking to here, a bucket per insert like one per erase
+        grow_buckets();
+        shrink_buckets();
+        queues_.on_insert(*node, key_hash);
+        if (deadline != no_deadline) {
+            node->set_deadline(deadline);
+            timers_.schedule(*node);
+        }
+        return { node, true };
     }
 
-    void insert_node(std::unique_ptr<lru_node> node) noexcept
+    // Inserts an entry read from a snapshot without counting it as a lookup.
+    // Entries come coldest first, so running out of budget evicts the oldest of them
+    void restore_node(Key&& key, Value&& value, clock::time_point deadline)
     {
-        if (!node) {
+        std::size_t key_hash = hash(key);
+        typename map::insert_commit_data commit_data;
+        if (!map_.insert_check(key, prehashed { key_hash }, map_.key_eq(), commit_data).second) {
             return;
         }
 
-        map_.insert(*node);
-        list_.insert(list_.end(), *node);
-        [[maybe_unused]] auto ignore = node.release();
+        lru_node* node = allocator_.allocate(std::move(key), std::move(value));
+        node->set_weight(weigher_(node->get_key(), node->get_value()));
+        evict_for(*node, key_hash, commit_data);
+
+        map_.insert_commit(*node, commit_data);
+        weight_ += node->weight();
+        stats_.on(lru_event::insert);
+        // Evictions above left shrinking to here, a bucket per insert like one per erase
+        grow_buckets();
+        shrink_buckets();
+        queues_.on_insert(*node, key_hash);
+        if (deadline != no_deadline) {
+            node->set_deadline(deadline);
+            timers_.schedule(*node);
+        }
     }
 
+    // Converts to the factory result, so the value is built right inside the node
+    template <typename Factory>
+    struct lazy_value {
+        Factory& factory_;
+
+        operator Value() const
+        {
+            return factory_();
+        }
+    };
+
 public:
-    lru_map(size_t max_size)
-        : max_size_(max_size)
-        , buckets_(max_size_)
-        , bucket_traits_(buckets_.data(), max_size_)
-        , map_(bucket_traits_)
-        , list_()
+    // Timer resolution bounds how late expire() may notice a deadline, lookups are always exact
+    lru_map(size_t max_size, clock::duration timer_resolution = std::chrono::milliseconds(1))
+        : lru_map(max_size, max_size, timer_resolution)
+    {
+    }
+
+    // Holds entries while their total weight fits max_weight, an entry heavier than
+    // the whole budget evicts everything else. Nodes are preallocated for
+    // expected_size entries, plus the one built before its victims are chosen,
+    // and the pool doubles past that. Buckets follow the live size
+    lru_map(size_t max_weight, size_t expected_size, clock::duration timer_resolution = std::chrono::milliseconds(1))
+        : max_weight_(max_weight)
+        , weight_(0)
+        , weigher_()
+        , allocator_(expected_size + 1)
+        , buckets_(2 * min_buckets)
+        , map_(bucket_traits(buckets_.data(), buckets_.size()))
+        , queues_(expected_size)
+        , timers_(timer_resolution)
+        , stats_()
+    {
+    }
+
+    lru_map(const lru_map&) = delete;
+
+    lru_map& operator=(const lru_map&) = delete;
+
+    ~lru_map()
+    {
+        map_.clear();
+        queues_.clear_and_dispose([this](lru_node* node) { allocator_.deallocate(node); });
+    }
+
+    template <typename K = Key>
+    bool contains(const K& key)
+    {
+        auto timer = stats_.start();
+        bool ret   = find(key) != nullptr;
+        stats_.on_latency(lru_op::contains, timer);
+        return ret;
+    }
+
+    // Returns the value and reports the hit to the policy, nullptr if key is missing
+    template <typename K = Key>
+    Value* find(const K& key)
+    {
+        lru_node* node = find_node(lookup_key(key));
+        return node == nullptr ? nullptr : &node->get_value();
+    }
+
+    // Looks up key without touching recency order, so it is safe to call
+    // concurrently as long as nothing modifies the map and Stats is
+    // lru_no_stats or lru_concurrent_stats
+    template <typename K = Key>
+    const Value* peek(const K& key) const
+    {
+        auto it = map_.find(lookup_key(key), map_.hash_function(), map_.key_eq());
+        if (it == map_.end() || stale(*it)) {
+            stats_.on(lru_event::miss);
+            return nullptr;
+        }
+
+        stats_.on(lru_event::hit);
+        return &it->get_value();
+    }
+
+    // Reports a hit seen earlier through peek() to the policy, for callers that
+    // defer recency updates. Stats already counted it and do not count it again
+    template <typename K = Key>
+    bool touch(const K& key)
+    {
+        return find_node(lookup_key(key), true) != nullptr;
+    }
+
+    template <typename K = Key>
+    Value& get(const K& key)
+    {
+        Value* value = find(key);
+        if (value == nullptr) {
+            throw std::out_of_range("lru_map::get: no such key");
+        }
+        return *value;
+    }
+
+    // Constructs value from args if key is missing, otherwise only marks it as recently used
+    template <typename K = Key, typename... Args>
+    std::pair<Value*, bool> try_emplace(const K& key, Args&&... args)
+    {
+        auto [node, inserted] = emplace_node(no_deadline, key, std::forward<Args>(args)...);
+        return { &node->get_value(), inserted };
+    }
+
+    // Calls factory only on miss
+    template <typename K = Key, typename Factory>
+    Value& get_or_compute(const K& key, Factory&& factory)
+    {
+        return emplace_node(no_deadline, key, lazy_value<Factory> { factory }).first->get_value();
+    }
+
+    // Computed value expires after ttl, an existing live value keeps its own deadline
+    template <typename K = Key, typename Factory>
+    Value& get_or_compute(const K& key, Factory&& factory, clock::duration ttl)
+    {
+        return emplace_node(clock::now() + ttl, key, lazy_value<Factory> { factory }).first->get_value();
+    }
+
+    template <typename K = Key>
+    bool put(const K& key, Value&& value)
     {
+        auto timer    = stats_.start();
+        bool inserted = emplace_node(no_deadline, key, std::move(value)).second;
+        stats_.on_latency(lru_op::put, timer);
+        return inserted;
     }
 
-    bool contains(const Key& key)
+    // Like put(), but the entry expires after ttl. An expired entry with the
+    // same key is replaced, a live one is left as is
+    template <typename K = Key>
+    bool put(const K& key, Value&& value, clock::duration ttl)
     {
-        auto it = map_.find(key, map_.hash_function(), map_.key_eq());
+        auto timer    = stats_.start();
+        bool inserted = emplace_node(clock::now() + ttl, key, std::move(value)).second;
+        stats_.on_latency(lru_op::put, timer);
+        return inserted;
+    }
+
+    // Looks up a batch of keys, values[i] is set to the value of keys[i] or nullptr.
+    // Same as find() for every key, but the cache misses of a group of keys overlap
+    // and the policy learns about the hits of a group after all its lookups.
+    // Expired entries are reported missing and left to expire(). Returns the number of hits
+    std::size_t get_many(std::span<const Key> keys, std::span<Value*> values)
+    {
+        if (keys.size() != values.size()) {
+            throw std::invalid_argument("lru_map::get_many: keys and values differ in size");
+        }
+
+        std::size_t hits = 0;
+        for_each_group(keys, [&](std::size_t first, std::size_t count, const std::size_t* hashes) {
+            lru_node* found[batch_group];
+            std::size_t found_count = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                queues_.on_access(hashes[i]);
+                auto it = map_.find(keys[first + i], prehashed { hashes[i] }, map_.key_eq());
+                if (it == map_.end() || stale(*it)) {
+                    stats_.on(lru_event::miss);
+                    values[first + i] = nullptr;
+                    continue;
+                }
+                stats_.on(lru_event::hit);
+                values[first + i]    = &it->get_value();
+                found[found_count++] = &*it;
+            }
+            // Promotion relinks the list neighbours of every hit, so their loads are issued together too
+            for (std::size_t i = 0; i < found_count; ++i) {
+                auto node = found[i]->lru_list_hook::this_ptr();
+                __builtin_prefetch(lru_list_hook::hooktags::node_traits::get_next(node), 1);
+                __builtin_prefetch(lru_list_hook::hooktags::node_traits::get_previous(node), 1);
+            }
+            for (std::size_t i = 0; i < found_count; ++i) {
+                queues_.on_hit(*found[i]);
+            }
+            hits += found_count;
+        });
+        return hits;
+    }
+
+    // Same as put() for every pair in order, with the bucket and chain loads of a group
+    // issued up front. Values are moved from. Returns the number of inserted keys
+    std::size_t put_many(std::span<const Key> keys, std::span<Value> values)
+    {
+        if (keys.size() != values.size()) {
+            throw std::invalid_argument("lru_map::put_many: keys and values differ in size");
+        }
+
+        std::size_t inserted = 0;
+        for_each_group(keys, [&](std::size_t first, std::size_t count, const std::size_t* hashes) {
+            for (std::size_t i = 0; i < count; ++i) {
+                std::size_t at = first + i;
+                inserted += emplace_hashed(hashes[i], no_deadline, keys[at], std::move(values[at])).second;
+            }
+        });
+        return inserted;
+    }
+
+    template <typename K = Key>
+    bool erase(const K& key)
+    {
+        auto it = map_.find(lookup_key(key), map_.hash_function(), map_.key_eq());
         if (it == map_.end()) {
             return false;
         }
 
-        list_.splice(list_.end(), list_, list_.iterator_to(*it));
+        erase_node(*it);
         return true;
     }
 
-    bool put(const Key& key, Value&& value)
+    // Evicts every entry whose deadline has passed, lookups already skip them,
+    // this only gives their memory back early. Returns the number of evicted entries
+    std::size_t expire(clock::time_point now = clock::now())
     {
-        auto it = map_.find(key, map_.hash_function(), map_.key_eq());
-        if (it != map_.end()) {
-            list_.splice(list_.end(), list_, list_.iterator_to(*it));
-            return false;
+        std::size_t expired = 0;
+        timers_.advance(now, [this, &expired](lru_node& node) {
+            erase_node(node);
+            stats_.on(lru_event::expiration);
+            ++expired;
+        });
+        return expired;
+    }
+
+    // Removes every entry, buckets and node pool keep their size
+    void clear() noexcept
+    {
+        map_.clear();
+        queues_.clear_and_dispose([this](lru_node* node) {
+            timers_.cancel(*node);
+            allocator_.deallocate(node);
+        });
+        weight_ = 0;
+    }
+
+    // Saved by lru_save() and loaded by lru_load(), see lru_snapshot.hpp
+    template <typename KeySerializer = lru_serializer<Key>, typename ValueSerializer = lru_serializer<Value>>
+    using snapshot = lru_snapshot<Key, Value, Hash, Equal, KeySerializer, ValueSerializer>;
+
+    // Includes expired entries not yet collected by expire() or a lookup
+    std::size_t size() const noexcept
+    {
+        return map_.size();
+    }
+
+    // Sum of entry weights, taken by the weigher on insert. Changing a value in
+    // place through find() or get() does not weigh it again
+    std::size_t weight() const noexcept
+    {
+        return weight_;
+    }
+
+    std::size_t max_weight() const noexcept
+    {
+        return max_weight_;
+    }
+
+    // Changes the budget online, entries are evicted only while the current weight exceeds it
+    void resize(std::size_t max_weight)
+    {
+        max_weight_ = max_weight;
+        while (!map_.empty() && weight_ > max_weight_) {
+            erase_node(queues_.victim(map_.hash_function()));
+            stats_.on(lru_event::eviction);
         }
-        if (map_.size() == max_size_) {
-            auto node = extract_node(list_.begin());
-            node->set_key(key);
-            node->set_value(std::move(value));
-            insert_node(std::move(node));
-        } else {
-            auto node = std::make_unique<lru_node>(key, std::move(value));
-            insert_node(std::move(node));
+    }
+
+    // Counters come from Stats and stay zero with lru_no_stats, the rest is
+    // read from the map. Walks every bucket, so it is meant for scraping, not hot paths
+    lru_stats_snapshot stats() const
+    {
+        lru_stats_snapshot snapshot;
+        stats_.collect(snapshot);
+        snapshot.size         = map_.size();
+        snapshot.weight       = weight_;
+        snapshot.max_weight   = max_weight_;
+        snapshot.bucket_count = map_.split_count();
+        for (std::size_t bucket = 0; bucket < map_.split_count(); ++bucket) {
+            std::size_t length = std::min(map_.bucket_size(bucket), lru_stats_snapshot::max_chain);
+            ++snapshot.chain_lengths[length];
         }
-        return true;
+        return snapshot;
     }
 
-    list::const_iterator begin() const
+    // Iterates in eviction order of the policy, coldest first
+    queues::const_iterator begin() const
     {
-        return list_.begin();
+        return queues_.begin();
     }
 
-    list::const_iterator end() const
+    queues::const_iterator end() const
     {
-        return list_.end();
+        return queues_.end();
     }
 };
@@ -0,0 +1,112 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include <boost/container/vector.hpp>
+
+// Default node allocator for intrusive lru containers.
+// Nodes live in contiguous slabs and are recycled through a free list,
+// so after construction the container never touches the heap.
+template <typename Node>
+class lru_node_pool {
+    union slot {
+        slot* next_;
+        alignas(Node) unsigned char storage_[sizeof(Node)];
+    };
+
+    using slab  = std::unique_ptr<slot[]>;
+    using slabs = boost::container::vector<slab>;
+
+    slabs slabs_;
+    slot* free_;
+    std::size_t capacity_;
+
+public:
+    explicit lru_node_pool(std::size_t capacity)
+        : slabs_()
+        , free_(nullptr)
+        , capacity_(0)
+    {
+        reserve(capacity);
+    }
+
+    lru_node_pool(const lru_node_pool&) = delete;
+
+    lru_node_pool& operator=(const lru_node_pool&) = delete;
+
+    // Nodes must be returned with deallocate() before the pool is destroyed
+    ~lru_node_pool() = default;
+
+    // Adds a new slab with room for extra nodes
+    void reserve(std::size_t extra)
+    {
+        if (extra == 0) {
+            return;
+        }
+
+        slab new_slab(new slot[extra]);
+        // Link in reverse, so nodes are handed out in address order
+        for (std::size_t i = extra; i > 0; --i) {
+            new_slab[i - 1].next_ = free_;
+            free_                 = &new_slab[i - 1];
+        }
+        slabs_.push_back(std::move(new_slab));
+        capacity_ += extra;
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        return capacity_;
+    }
+
+    template <typename... Args>
+    Node* allocate(Args&&... args)
+    {
+        if (free_ == nullptr) {
+            reserve(capacity_ == 0 ? 1 : capacity_);
+        }
+
+        slot* ret = free_;
+        free_     = ret->next_;
+        try {
+            return ::new (static_cast<void*>(ret->storage_)) Node(std::forward<Args>(args)...);
+        } catch (...) {
+            ret->next_ = free_;
+            free_      = ret;
+            throw;
+        }
+    }
+
+    void deallocate(Node* node) noexcept
+    {
+        node->~Node();
+        slot* ret  = reinterpret_cast<slot*>(node);
+        ret->next_ = free_;
+        free_      = ret;
+    }
+};
+
+// Allocates every node separately on the heap
+template <typename Node>
+class lru_node_heap {
+public:
+    explicit lru_node_heap(std::size_t)
+    {
+    }
+
+    template <typename... Args>
+    Node* allocate(Args&&... args)
+    {
+        return new Node(std::forward<Args>(args)...);
+    }
+
+    void deallocate(Node* node) noexcept
+    {
+        delete node;
+    }
+};
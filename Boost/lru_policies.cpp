@@ -0,0 +1,103 @@
+// Copyright 2024 Severin Denisenko
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "lru_map.hpp"
+
+// Replays a key trace against lru_map with every eviction policy
+// and reports hit ratio and throughput.
+//
+// Usage: lru_policies [trace_file [capacity]]
+// Trace file is a whitespace separated list of integer keys. Without it a
+// Zipf distributed trace interrupted by large sequential scans is generated.
+
+using number_t = uint64_t;
+using trace_t  = std::vector<number_t>;
+
+static constexpr std::size_t default_capacity_ { 10'000 };
+static constexpr std::size_t hot_keys_ { 100'000 };
+static constexpr std::size_t requests_ { 2'000'000 };
+static constexpr std::size_t scan_every_ { 200'000 };
+static constexpr std::size_t scan_length_ { 50'000 };
+static constexpr double zipf_skew_ { 0.9 };
+
+trace_t generate_trace()
+{
+    std::vector<double> cdf(hot_keys_);
+    double total = 0;
+    for (std::size_t i = 0; i < hot_keys_; ++i) {
+        total += 1.0 / std::pow(i + 1, zipf_skew_);
+        cdf[i] = total;
+    }
+
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> dist(0, total);
+
+    trace_t trace;
+    trace.reserve(requests_ + requests_ / scan_every_ * scan_length_);
+    number_t scan_key = hot_keys_;
+    for (std::size_t i = 0; i < requests_; ++i) {
+        if (i % scan_every_ == 0) {
+            // Batch job: every key is touched once and never again
+            for (std::size_t j = 0; j < scan_length_; ++j) {
+                trace.push_back(scan_key++);
+            }
+        }
+        trace.push_back(std::upper_bound(cdf.begin(), cdf.end(), dist(rng)) - cdf.begin());
+    }
+    return trace;
+}
+
+trace_t load_trace(const char* path)
+{
+    std::ifstream file(path);
+    trace_t trace;
+    number_t key;
+    while (file >> key) {
+        trace.push_back(key);
+    }
+    return trace;
+}
+
+template <typename Policy>
+void replay(const char* name, const trace_t& trace, std::size_t capacity)
+{
+    using cache_t = lru_map<number_t, number_t, std::hash<number_t>, std::equal_to<number_t>, lru_node_pool, Policy>;
+    cache_t cache { capacity };
+
+    std::size_t hits = 0;
+    auto start       = std::chrono::steady_clock::now();
+    for (number_t key : trace) {
+        hits += !cache.try_emplace(key, key).second;
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double> seconds = stop - start;
+    std::cout << fmt::format(
+        "{:>10} {:>9.2f}% {:>14.0f}\n", name, 100.0 * hits / trace.size(), trace.size() / seconds.count());
+}
+
+int main(int argc, char** argv)
+{
+    trace_t trace        = argc > 1 ? load_trace(argv[1]) : generate_trace();
+    std::size_t capacity = argc > 2 ? std::stoul(argv[2]) : default_capacity_;
+
+    std::cout << fmt::format("{} requests, capacity {}\n", trace.size(), capacity);
+    std::cout << fmt::format("{:>10} {:>10} {:>14}\n", "policy", "hit ratio", "ops/sec");
+
+    replay<lru_policy>("lru", trace, capacity);
+    replay<slru_policy<>>("slru", trace, capacity);
+    replay<s3fifo_policy<>>("s3fifo", trace, capacity);
+    replay<wtinylfu_policy<>>("w-tinylfu", trace, capacity);
+
+    return 0;
+}
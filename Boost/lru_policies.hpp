@@ -0,0 +1,619 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include <boost/intrusive/list.hpp>
+#include <boost/intrusive/options.hpp>
+
+#include <boost/container/vector.hpp>
+
+// Eviction policies for lru_map.
+//
+// A policy owns the queues nodes are linked into through their list hook and
+// decides which node to evict. Every node sits in exactly one queue at a time,
+// per node metadata lives in Policy::node_data. The map calls:
+//
+//  * on_access(hash) for every lookup that may insert, hit or miss
+//  * on_hit(node) when a lookup finds the node
+//  * on_insert(node, hash) after the node is added
+//  * victim(hasher) when the map is full, the returned node is erased right after
+//  * on_erase(node) before the node is destroyed
+
+// Iterates over several lists one after another
+template <typename List, std::size_t N>
+class lru_segments_iterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = List::value_type;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const value_type*;
+    using reference         = const value_type&;
+    using lists             = std::array<const List*, N>;
+
+    lru_segments_iterator()
+        : lists_ {}
+        , segment_(N)
+        , it_()
+    {
+    }
+
+    explicit lru_segments_iterator(lists segments)
+        : lists_(segments)
+        , segment_(0)
+        , it_(lists_[0]->begin())
+    {
+        skip_empty();
+    }
+
+    reference operator*() const
+    {
+        return *it_;
+    }
+
+    pointer operator->() const
+    {
+        return &*it_;
+    }
+
+    lru_segments_iterator& operator++()
+    {
+        ++it_;
+        skip_empty();
+        return *this;
+    }
+
+    lru_segments_iterator operator++(int)
+    {
+        lru_segments_iterator ret = *this;
+        ++*this;
+        return ret;
+    }
+
+    bool operator==(const lru_segments_iterator& other) const
+    {
+        return segment_ == other.segment_ && (segment_ == N || it_ == other.it_);
+    }
+
+private:
+    void skip_empty()
+    {
+        while (segment_ < N && it_ == lists_[segment_]->end()) {
+            if (++segment_ < N) {
+                it_ = lists_[segment_]->begin();
+            }
+        }
+    }
+
+    lists lists_;
+    std::size_t segment_;
+    List::const_iterator it_;
+};
+
+// Scrambles the bits, so policies can index tables with weak hashes like std::hash<int>
+inline std::uint64_t lru_mix_hash(std::uint64_t hash) noexcept
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Approximate frequency of hashes in 4 bit saturating counters.
+// All counters are halved after a sample of 10 * capacity increments,
+// so the history slowly forgets old popularity.
+class lru_count_min_sketch {
+    static constexpr std::size_t depth_       = 4;
+    static constexpr std::uint8_t max_counter = 15;
+
+public:
+    explicit lru_count_min_sketch(std::size_t capacity)
+        : width_(std::bit_ceil(std::max<std::size_t>(capacity, 16)))
+        , counters_(depth_ * width_, 0)
+        , additions_(0)
+        , sample_size_(10 * width_)
+    {
+    }
+
+    void increment(std::size_t hash) noexcept
+    {
+        std::uint64_t mixed = lru_mix_hash(hash);
+        for (std::size_t row = 0; row < depth_; ++row) {
+            std::uint8_t& counter = counters_[index(mixed, row)];
+            if (counter < max_counter) {
+                ++counter;
+            }
+        }
+
+        if (++additions_ == sample_size_) {
+            reset();
+        }
+    }
+
+    std::uint8_t estimate(std::size_t hash) const noexcept
+    {
+        std::uint64_t mixed = lru_mix_hash(hash);
+        std::uint8_t ret    = max_counter;
+        for (std::size_t row = 0; row < depth_; ++row) {
+            ret = std::min(ret, counters_[index(mixed, row)]);
+        }
+        return ret;
+    }
+
+private:
+    std::size_t index(std::uint64_t mixed, std::size_t row) const noexcept
+    {
+        // Every row takes its own 16 bits of the mixed hash, rotated by a row specific amount
+        std::uint64_t row_hash = std::rotr(mixed, static_cast<int>(16 * row)) * (2 * row + 1);
+        return row * width_ + (row_hash & (width_ - 1));
+    }
+
+    void reset() noexcept
+    {
+        for (std::uint8_t& counter : counters_) {
+            counter >>= 1;
+        }
+        additions_ /= 2;
+    }
+
+    std::size_t width_;
+    boost::container::vector<std::uint8_t> counters_;
+    std::size_t additions_;
+    std::size_t sample_size_;
+};
+
+// Remembers hashes of recently evicted keys without keeping the keys.
+// Hashes live in a FIFO ring and a direct mapped table, colliding hashes
+// overwrite each other, which is fine for a hint.
+class lru_ghost_queue {
+public:
+    explicit lru_ghost_queue(std::size_t capacity)
+        : ring_(std::max<std::size_t>(capacity, 1), 0)
+        , table_(std::bit_ceil(2 * ring_.size()), 0)
+        , head_(0)
+    {
+    }
+
+    void push(std::size_t hash) noexcept
+    {
+        std::size_t& oldest = ring_[head_];
+        if (oldest != 0 && table_[slot(oldest)] == oldest) {
+            table_[slot(oldest)] = 0;
+        }
+
+        oldest             = tag(hash);
+        table_[slot(hash)] = tag(hash);
+        head_              = (head_ + 1) % ring_.size();
+    }
+
+    // Forgets the hash, so one ghost hit promotes only once
+    bool pop(std::size_t hash) noexcept
+    {
+        std::size_t& entry = table_[slot(hash)];
+        if (entry != tag(hash)) {
+            return false;
+        }
+        entry = 0;
+        return true;
+    }
+
+private:
+    // Zero marks empty entries
+    static std::size_t tag(std::size_t hash) noexcept
+    {
+        return hash | 1;
+    }
+
+    std::size_t slot(std::size_t hash) const noexcept
+    {
+        return lru_mix_hash(tag(hash)) & (table_.size() - 1);
+    }
+
+    boost::container::vector<std::size_t> ring_;
+    boost::container::vector<std::size_t> table_;
+    std::size_t head_;
+};
+
+// Strict LRU: hits move the node to the tail, the head is evicted
+struct lru_policy {
+    struct node_data { };
+
+    template <typename Node>
+    class queues {
+    public:
+        using list           = boost::intrusive::list<Node, boost::intrusive::constant_time_size<false>>;
+        using const_iterator = list::const_iterator;
+
+        explicit queues(std::size_t)
+        {
+        }
+
+        void on_access(std::size_t) noexcept
+        {
+        }
+
+        void on_hit(Node& node) noexcept
+        {
+            list_.splice(list_.end(), list_, list_.iterator_to(node));
+        }
+
+        void on_insert(Node& node, std::size_t) noexcept
+        {
+            list_.push_back(node);
+        }
+
+        template <typename Hasher>
+        Node& victim(const Hasher&) noexcept
+        {
+            return list_.front();
+        }
+
+        void on_erase(Node& node) noexcept
+        {
+            list_.erase(list_.iterator_to(node));
+        }
+
+        template <typename Disposer>
+        void clear_and_dispose(Disposer disposer) noexcept
+        {
+            list_.clear_and_dispose(disposer);
+        }
+
+        const_iterator begin() const
+        {
+            return list_.begin();
+        }
+
+        const_iterator end() const
+        {
+            return list_.end();
+        }
+
+    private:
+        list list_;
+    };
+};
+
+// Segmented LRU, the 2Q flavour used by most caches.
+// New keys enter the probation segment, a second hit promotes them to the
+// protected segment. Only probation is evicted from, so a scan of one-hit
+// keys can not flush the protected working set.
+template <std::size_t ProtectedPercent = 80>
+struct slru_policy {
+    struct node_data {
+        bool protected_ = false;
+    };
+
+    template <typename Node>
+    class queues {
+    public:
+        using list           = boost::intrusive::list<Node, boost::intrusive::constant_time_size<true>>;
+        using const_iterator = lru_segments_iterator<list, 2>;
+
+        explicit queues(std::size_t)
+        {
+        }
+
+        void on_access(std::size_t) noexcept
+        {
+        }
+
+        void on_hit(Node& node) noexcept
+        {
+            if (node.policy_data().protected_) {
+                protected_.splice(protected_.end(), protected_, protected_.iterator_to(node));
+                return;
+            }
+
+            probation_.erase(probation_.iterator_to(node));
+            protected_.push_back(node);
+            node.policy_data().protected_ = true;
+
+            if (protected_.size() * 100 > (probation_.size() + protected_.size()) * ProtectedPercent) {
+                Node& demoted = protected_.front();
+                protected_.pop_front();
+                probation_.push_back(demoted);
+                demoted.policy_data().protected_ = false;
+            }
+        }
+
+        void on_insert(Node& node, std::size_t) noexcept
+        {
+            node.policy_data().protected_ = false;
+            probation_.push_back(node);
+        }
+
+        template <typename Hasher>
+        Node& victim(const Hasher&) noexcept
+        {
+            return probation_.empty() ? protected_.front() : probation_.front();
+        }
+
+        void on_erase(Node& node) noexcept
+        {
+            list& from = node.policy_data().protected_ ? protected_ : probation_;
+            from.erase(from.iterator_to(node));
+        }
+
+        template <typename Disposer>
+        void clear_and_dispose(Disposer disposer) noexcept
+        {
+            probation_.clear_and_dispose(disposer);
+            protected_.clear_and_dispose(disposer);
+        }
+
+        const_iterator begin() const
+        {
+            return const_iterator({ &probation_, &protected_ });
+        }
+
+        const_iterator end() const
+        {
+            return const_iterator();
+        }
+
+    private:
+        list probation_;
+        list protected_;
+    };
+};
+
+// S3-FIFO: a small FIFO filters one-hit wonders, a main FIFO keeps the rest
+// and a ghost queue remembers keys recently dropped from the small one.
+// Hits only bump a 2 bit counter and never touch the lists.
+template <std::size_t SmallPercent = 10>
+struct s3fifo_policy {
+    struct node_data {
+        std::uint8_t freq_ = 0;
+        bool main_         = false;
+    };
+
+    template <typename Node>
+    class queues {
+        static constexpr std::uint8_t max_freq = 3;
+
+    public:
+        using list           = boost::intrusive::list<Node, boost::intrusive::constant_time_size<true>>;
+        using const_iterator = lru_segments_iterator<list, 2>;
+
+        explicit queues(std::size_t max_size)
+            : small_()
+            , main_()
+            , ghost_(max_size)
+        {
+        }
+
+        void on_access(std::size_t) noexcept
+        {
+        }
+
+        void on_hit(Node& node) noexcept
+        {
+            std::uint8_t& freq = node.policy_data().freq_;
+            freq               = std::min<std::uint8_t>(freq + 1, max_freq);
+        }
+
+        void on_insert(Node& node, std::size_t hash) noexcept
+        {
+            node_data& data = node.policy_data();
+            data.freq_      = 0;
+            data.main_      = ghost_.pop(hash);
+            (data.main_ ? main_ : small_).push_back(node);
+        }
+
+        template <typename Hasher>
+        Node& victim(const Hasher& hasher) noexcept
+        {
+            while (true) {
+                bool from_small = !small_.empty()
+                    && (main_.empty() || small_.size() * 100 >= (small_.size() + main_.size()) * SmallPercent);
+
+                if (from_small) {
+                    Node& node = small_.front();
+                    if (node.policy_data().freq_ > 1) {
+                        small_.pop_front();
+                        main_.push_back(node);
+                        node.policy_data() = node_data { .freq_ = 0, .main_ = true };
+                        continue;
+                    }
+                    ghost_.push(hasher(node));
+                    return node;
+                }
+
+                Node& node = main_.front();
+                if (node.policy_data().freq_ > 0) {
+                    --node.policy_data().freq_;
+                    main_.splice(main_.end(), main_, main_.begin());
+                    continue;
+                }
+                return node;
+            }
+        }
+
+        void on_erase(Node& node) noexcept
+        {
+            list& from = node.policy_data().main_ ? main_ : small_;
+            from.erase(from.iterator_to(node));
+        }
+
+        template <typename Disposer>
+        void clear_and_dispose(Disposer disposer) noexcept
+        {
+            small_.clear_and_dispose(disposer);
+            main_.clear_and_dispose(disposer);
+        }
+
+        const_iterator begin() const
+        {
+            return const_iterator({ &small_, &main_ });
+        }
+
+        const_iterator end() const
+        {
+            return const_iterator();
+        }
+
+    private:
+        list small_;
+        list main_;
+        lru_ghost_queue ghost_;
+    };
+};
+
+// W-TinyLFU: new keys land in a small LRU window, keys leaving the window
+// have to beat the segmented LRU victim by frequency in a count-min sketch
+// to be admitted, otherwise they are evicted.
+template <std::size_t WindowPercent = 1, std::size_t ProtectedPercent = 80>
+struct wtinylfu_policy {
+    enum class segment : std::uint8_t {
+        window,
+        probation,
+        protected_,
+    };
+
+    struct node_data {
+        segment segment_ = segment::window;
+    };
+
+    template <typename Node>
+    class queues {
+    public:
+        using list           = boost::intrusive::list<Node, boost::intrusive::constant_time_size<true>>;
+        using const_iterator = lru_segments_iterator<list, 3>;
+
+        explicit queues(std::size_t max_size)
+            : sketch_(max_size)
+            , window_()
+            , probation_()
+            , protected_()
+        {
+        }
+
+        void on_access(std::size_t hash) noexcept
+        {
+            sketch_.increment(hash);
+        }
+
+        void on_hit(Node& node) noexcept
+        {
+            switch (node.policy_data().segment_) {
+            case segment::window:
+                window_.splice(window_.end(), window_, window_.iterator_to(node));
+                break;
+            case segment::probation:
+                probation_.erase(probation_.iterator_to(node));
+                move_to(node, protected_, segment::protected_);
+                if (protected_.size() * 100 > main_size() * ProtectedPercent) {
+                    Node& demoted = protected_.front();
+                    protected_.pop_front();
+                    move_to(demoted, probation_, segment::probation);
+                }
+                break;
+            case segment::protected_:
+                protected_.splice(protected_.end(), protected_, protected_.iterator_to(node));
+                break;
+            }
+        }
+
+        void on_insert(Node& node, std::size_t) noexcept
+        {
+            move_to(node, window_, segment::window);
+            // Until the map is full keys leave the window without a contest
+            while (window_.size() > window_capacity()) {
+                Node& overflow = window_.front();
+                window_.pop_front();
+                move_to(overflow, probation_, segment::probation);
+            }
+        }
+
+        template <typename Hasher>
+        Node& victim(const Hasher& hasher) noexcept
+        {
+            if (main_size() == 0) {
+                return window_.front();
+            }
+
+            Node& main_victim = probation_.empty() ? protected_.front() : probation_.front();
+            if (window_.empty() || window_.size() < window_capacity()) {
+                return main_victim;
+            }
+
+            // The new key pushes the window head out, it competes with the main victim
+            Node& candidate = window_.front();
+            if (sketch_.estimate(hasher(candidate)) <= sketch_.estimate(hasher(main_victim))) {
+                return candidate;
+            }
+
+            window_.pop_front();
+            move_to(candidate, probation_, segment::probation);
+            return main_victim;
+        }
+
+        void on_erase(Node& node) noexcept
+        {
+            list& from = segment_list(node.policy_data().segment_);
+            from.erase(from.iterator_to(node));
+        }
+
+        template <typename Disposer>
+        void clear_and_dispose(Disposer disposer) noexcept
+        {
+            window_.clear_and_dispose(disposer);
+            probation_.clear_and_dispose(disposer);
+            protected_.clear_and_dispose(disposer);
+        }
+
+        const_iterator begin() const
+        {
+            return const_iterator({ &window_, &probation_, &protected_ });
+        }
+
+        const_iterator end() const
+        {
+            return const_iterator();
+        }
+
+    private:
+        std::size_t main_size() const noexcept
+        {
+            return probation_.size() + protected_.size();
+        }
+
+        std::size_t window_capacity() const noexcept
+        {
+            return std::max<std::size_t>(1, (window_.size() + main_size()) * WindowPercent / 100);
+        }
+
+        list& segment_list(segment from) noexcept
+        {
+            switch (from) {
+            case segment::window:
+                return window_;
+            case segment::probation:
+                return probation_;
+            case segment::protected_:
+                break;
+            }
+            return protected_;
+        }
+
+        void move_to(Node& node, list& to, segment name) noexcept
+        {
+            to.push_back(node);
+            node.policy_data().segment_ = name;
+        }
+
+        lru_count_min_sketch sketch_;
+        list window_;
+        list probation_;
+        list protected_;
+    };
+};
@@ -1,13 +1,25 @@
 // Copyright 2024 Severin Denisenko
 
 #include <iostream>
+#include <string>
+#include <string_view>
 
 #include <fmt/format.h>
 
 #include "lru_set.hpp"
 
-template <typename T>
-void print(lru_set<T>& set)
+// Transparent hash lets the set look up std::string keys by std::string_view
+struct string_hash {
+    using is_transparent = void;
+
+    std::size_t operator()(std::string_view str) const
+    {
+        return std::hash<std::string_view> {}(str);
+    }
+};
+
+template <typename Set>
+void print(Set& set)
 {
     for (const auto& val : set) {
         std::cout << fmt::format("{} ", val.get_key());
@@ -35,5 +47,19 @@ int main()
 
     print(set);
 
+    lru_set<std::string, string_hash, std::equal_to<>> strings { 2 };
+
+    strings.put(std::string_view { "one" });
+    strings.put("two");
+    strings.contains(std::string_view { "one" });
+    strings.put("three");
+
+    print(strings);
+
+    // Capacity 0 keeps nothing
+    strings.resize(0);
+    strings.put("four");
+    std::cout << fmt::format("{} keys after resize(0)\n", strings.size());
+
     return 0;
 }
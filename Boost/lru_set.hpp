@@ -2,7 +2,9 @@
 
 #pragma once
 
-#include <memory>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
 
 #include <boost/intrusive/link_mode.hpp>
 #include <boost/intrusive/list.hpp>
@@ -13,12 +15,20 @@
 
 #include <boost/container/vector.hpp>
 
-template <typename Key, typename Hash = std::hash<Key>, typename Equal = std::equal_to<Key>>
+#include "lru_node_pool.hpp"
+#include "lru_stats.hpp"
+
+template <
+    typename Key,
+    typename Hash                      = std::hash<Key>,
+    typename Equal                     = std::equal_to<Key>,
+    template <typename> typename Alloc = lru_node_pool,
+    typename Stats                     = lru_no_stats>
 class lru_set {
 public:
     using link_mode = boost::intrusive::link_mode<
 #ifdef NDEBUG
-        boost::inintrusive::normal_link
+        boost::intrusive::normal_link
 #else
         boost::intrusive::safe_link
 #endif
@@ -49,7 +59,8 @@ public:
     };
 
     struct lru_node_hash : Hash {
-        auto operator()(const Key& a) const
+        template <typename K>
+        auto operator()(const K& a) const
         {
             return Hash::operator()(a);
         }
@@ -66,12 +77,14 @@ public:
             return Equal::operator()(a.get_key(), b.get_key());
         }
 
-        auto operator()(const Key& a, const lru_node& b) const
+        template <typename K>
+        auto operator()(const K& a, const lru_node& b) const
         {
             return Equal::operator()(a, b.get_key());
         }
 
-        auto operator()(const lru_node& a, const Key& b) const
+        template <typename K>
+        auto operator()(const lru_node& a, const K& b) const
         {
             return Equal::operator()(a.get_key(), b);
         }
@@ -82,8 +95,29 @@ public:
         }
     };
 
+    // Hash and Equal accept types other than Key, like std::string_view for std::string
+    static constexpr bool is_transparent = requires {
+        typename Hash::is_transparent;
+        typename Equal::is_transparent;
+    };
+
+    // Without transparent Hash and Equal the key is converted before lookup, like before
+    template <typename K>
+    static decltype(auto) lookup_key(const K& key)
+    {
+        if constexpr (is_transparent || std::is_same_v<K, Key>) {
+            return (key);
+        } else {
+            return Key(key);
+        }
+    }
+
+    // Incremental hashing, see lru_map
     using map = boost::intrusive::unordered_set<lru_node, boost::intrusive::constant_time_size<true>,
-        boost::intrusive::hash<lru_node_hash>, boost::intrusive::equal<lru_node_equal>>;
+        boost::intrusive::hash<lru_node_hash>, boost::intrusive::equal<lru_node_equal>,
+        boost::intrusive::power_2_buckets<true>, boost::intrusive::incremental<true>>;
+
+    static constexpr std::size_t min_buckets = 8;
 
     using bucket_traits = map::bucket_traits;
     using bucket        = map::bucket_type;
@@ -91,68 +125,148 @@ public:
 
     using list = boost::intrusive::list<lru_node, boost::intrusive::constant_time_size<false>>;
 
+    using allocator = Alloc<lru_node>;
+
     std::size_t max_size_;
+    allocator allocator_;
     buckets buckets_;
-    bucket_traits bucket_traits_;
     map map_;
     list list_;
+    [[no_unique_address]] Stats stats_;
 
-    std::unique_ptr<lru_node> extract_node(typename list::iterator it) noexcept
+    void erase_node(lru_node& node)
     {
-        std::unique_ptr<lru_node> ret(&*it);
-        map_.erase(map_.iterator_to(*it));
-        list_.erase(it);
-        return ret;
+        map_.erase(map_.iterator_to(node));
+        list_.erase(list_.iterator_to(node));
+        allocator_.deallocate(&node);
+        shrink_buckets();
     }
 
-    void insert_node(std::unique_ptr<lru_node> node) noexcept
+    void insert_node(lru_node& node)
     {
-        if (!node) {
+        map_.insert(node);
+        list_.insert(list_.end(), node);
+        grow_buckets();
+    }
+
+    void grow_buckets()
+    {
+        if (map_.size() <= map_.split_count()) {
             return;
         }
+        if (map_.split_count() == buckets_.size()) {
+            buckets bigger(buckets_.size() * 2);
+            map_.incremental_rehash(bucket_traits(bigger.data(), bigger.size()));
+            buckets_.swap(bigger);
+        }
+        map_.incremental_rehash(true);
+    }
 
-        map_.insert(*node);
-        list_.insert(list_.end(), *node);
-        [[maybe_unused]] auto ignore = node.release();
+    void shrink_buckets()
+    {
+        if (map_.split_count() <= min_buckets || map_.size() * 4 >= map_.split_count()) {
+            return;
+        }
+        if (map_.split_count() == buckets_.size() / 2) {
+            buckets smaller(buckets_.size() / 2);
+            map_.incremental_rehash(bucket_traits(smaller.data(), smaller.size()));
+            buckets_.swap(smaller);
+        }
+        map_.incremental_rehash(false);
     }
 
 public:
     lru_set(size_t max_size)
         : max_size_(max_size)
-        , buckets_(max_size_)
-        , bucket_traits_(buckets_.data(), max_size_)
-        , map_(bucket_traits_)
+        , allocator_(max_size_)
+        , buckets_(2 * min_buckets)
+        , map_(bucket_traits(buckets_.data(), buckets_.size()))
         , list_()
+        , stats_()
     {
     }
 
-    bool contains(const Key& key)
+    lru_set(const lru_set&) = delete;
+
+    lru_set& operator=(const lru_set&) = delete;
+
+    ~lru_set()
+    {
+        map_.clear();
+        list_.clear_and_dispose([this](lru_node* node) { allocator_.deallocate(node); });
+    }
+
+    template <typename K = Key>
+    bool contains(const K& key)
     {
-        auto it = map_.find(key, map_.hash_function(), map_.key_eq());
-        if (it == map_.end()) {
-            return false;
+        auto timer = stats_.start();
+        auto it    = map_.find(lookup_key(key), map_.hash_function(), map_.key_eq());
+        bool found = it != map_.end();
+        if (found) {
+            list_.splice(list_.end(), list_, list_.iterator_to(*it));
         }
 
-        list_.splice(list_.end(), list_, list_.iterator_to(*it));
-        return true;
+        stats_.on(found ? lru_event::hit : lru_event::miss);
+        stats_.on_latency(lru_op::contains, timer);
+        return found;
     }
 
-    bool put(const Key& key)
+    template <typename K = Key>
+    bool put(const K& key)
     {
-        auto it = map_.find(key, map_.hash_function(), map_.key_eq());
+        auto timer            = stats_.start();
+        decltype(auto) lookup = lookup_key(key);
+        auto it               = map_.find(lookup, map_.hash_function(), map_.key_eq());
+        bool inserted         = it == map_.end() && max_size_ != 0;
         if (it != map_.end()) {
             list_.splice(list_.end(), list_, list_.iterator_to(*it));
-            return false;
-        }
-        if (map_.size() == max_size_) {
-            auto node = extract_node(list_.begin());
-            node->set_key(key);
-            insert_node(std::move(node));
+            stats_.on(lru_event::hit);
         } else {
-            auto node = std::make_unique<lru_node>(Key(key));
-            insert_node(std::move(node));
+            stats_.on(lru_event::miss);
+            // A set of capacity 0 keeps nothing, so there is nothing to evict either
+            if (inserted) {
+                if (map_.size() == max_size_) {
+                    erase_node(list_.front());
+                    stats_.on(lru_event::eviction);
+                }
+                insert_node(*allocator_.allocate(Key(std::forward<decltype(lookup)>(lookup))));
+                stats_.on(lru_event::insert);
+            }
+        }
+
+        stats_.on_latency(lru_op::put, timer);
+        return inserted;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return map_.size();
+    }
+
+    // Changes capacity online, evicting the least recently used keys that no longer fit
+    void resize(std::size_t max_size)
+    {
+        max_size_ = max_size;
+        while (map_.size() > max_size_) {
+            erase_node(list_.front());
+            stats_.on(lru_event::eviction);
+        }
+    }
+
+    // Counters come from Stats and stay zero with lru_no_stats, the rest is read from the set
+    lru_stats_snapshot stats() const
+    {
+        lru_stats_snapshot snapshot;
+        stats_.collect(snapshot);
+        snapshot.size         = map_.size();
+        snapshot.weight       = map_.size();
+        snapshot.max_weight   = max_size_;
+        snapshot.bucket_count = map_.split_count();
+        for (std::size_t bucket = 0; bucket < map_.split_count(); ++bucket) {
+            std::size_t length = std::min(map_.bucket_size(bucket), lru_stats_snapshot::max_chain);
+            ++snapshot.chain_lengths[length];
         }
-        return true;
+        return snapshot;
     }
 
     list::const_iterator begin() const
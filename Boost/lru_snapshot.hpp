@@ -0,0 +1,413 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+// Snapshot file of lru_map contents, written by lru_save() and read back by
+// lru_load() or served directly by lru_snapshot while the map is rebuilt.
+//
+// Layout, integers in native byte order, every part aligned to 8 bytes:
+//
+//  * lru_snapshot_header
+//  * records in eviction order, coldest first: lru_snapshot_record, key bytes, value bytes
+//  * index, open addressing table of lru_snapshot_slot with linear probing, at most half full
+//
+// Deadlines are stored as system clock time, steady clock time does not survive a restart.
+// The index is built with the Hash of the map, a reader must use the same one.
+
+// Turns a key or value into bytes and back. The default handles trivially copyable
+// types and strings, other types get a specialization or a serializer of their own
+// passed to lru_save() and lru_load()
+template <typename T>
+struct lru_serializer;
+
+template <typename T>
+    requires std::is_trivially_copyable_v<T>
+struct lru_serializer<T> {
+    static std::size_t size(const T&) noexcept
+    {
+        return sizeof(T);
+    }
+
+    static void write(const T& value, std::byte* out) noexcept
+    {
+        std::memcpy(out, &value, sizeof(T));
+    }
+
+    static T read(const std::byte* in, std::size_t) noexcept
+    {
+        alignas(T) std::byte storage[sizeof(T)];
+        std::memcpy(storage, in, sizeof(T));
+        return *std::launder(reinterpret_cast<T*>(storage));
+    }
+};
+
+template <typename Char, typename Traits, typename Alloc>
+struct lru_serializer<std::basic_string<Char, Traits, Alloc>> {
+    using string = std::basic_string<Char, Traits, Alloc>;
+
+    static std::size_t size(const string& value) noexcept
+    {
+        return value.size() * sizeof(Char);
+    }
+
+    static void write(const string& value, std::byte* out) noexcept
+    {
+        std::memcpy(out, value.data(), value.size() * sizeof(Char));
+    }
+
+    static string read(const std::byte* in, std::size_t size)
+    {
+        string ret(size / sizeof(Char), Char());
+        std::memcpy(ret.data(), in, size);
+        return ret;
+    }
+};
+
+struct lru_snapshot_header {
+    static constexpr char expected_magic[8]   = { 'l', 'r', 'u', 's', 'n', 'a', 'p', '\0' };
+    static constexpr uint32_t current_version = 1;
+    // Reads back as another number on a machine with different byte order
+    static constexpr uint32_t expected_byte_order = 0x01020304;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t count;
+    uint64_t index_offset;
+    uint64_t index_size;
+    uint64_t file_size;
+};
+
+struct lru_snapshot_record {
+    static constexpr int64_t no_deadline = std::numeric_limits<int64_t>::max();
+
+    // Nanoseconds of system clock since epoch
+    int64_t deadline;
+    uint32_t key_size;
+    uint32_t value_size;
+};
+
+// Offset 0 is inside the header, so it marks a free slot
+struct lru_snapshot_slot {
+    uint64_t hash;
+    uint64_t offset;
+};
+
+template <
+    typename Key,
+    typename Value,
+    typename Hash            = std::hash<Key>,
+    typename Equal           = std::equal_to<Key>,
+    typename KeySerializer   = lru_serializer<Key>,
+    typename ValueSerializer = lru_serializer<Value>>
+class lru_snapshot {
+public:
+    using clock = std::chrono::system_clock;
+
+    static constexpr clock::time_point no_deadline = clock::time_point::max();
+
+private:
+    boost::interprocess::file_mapping file_;
+    boost::interprocess::mapped_region region_;
+    const std::byte* data_;
+    const lru_snapshot_header* header_;
+    const lru_snapshot_slot* index_;
+    [[no_unique_address]] Hash hash_;
+    [[no_unique_address]] Equal equal_;
+
+    static constexpr std::size_t align(std::size_t size) noexcept
+    {
+        return (size + 7) & ~std::size_t { 7 };
+    }
+
+    static std::size_t record_size(std::size_t key_size, std::size_t value_size) noexcept
+    {
+        return sizeof(lru_snapshot_record) + align(key_size) + align(value_size);
+    }
+
+    // std::hash of an integer is the integer itself, mixing spreads sequential keys over the index
+    static std::size_t first_slot(uint64_t hash, uint64_t index_size) noexcept
+    {
+        uint64_t mixed = hash * 0x9e3779b97f4a7c15;
+        return (mixed ^ (mixed >> 32)) & (index_size - 1);
+    }
+
+    static int64_t to_file(clock::time_point deadline) noexcept
+    {
+        if (deadline == no_deadline) {
+            return lru_snapshot_record::no_deadline;
+        }
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    }
+
+    static clock::time_point from_file(int64_t deadline) noexcept
+    {
+        if (deadline == lru_snapshot_record::no_deadline) {
+            return no_deadline;
+        }
+        return clock::time_point(std::chrono::duration_cast<clock::duration>(std::chrono::nanoseconds(deadline)));
+    }
+
+    const lru_snapshot_record& record_at(uint64_t offset) const noexcept
+    {
+        return *reinterpret_cast<const lru_snapshot_record*>(data_ + offset);
+    }
+
+    static const std::byte* key_bytes(const lru_snapshot_record& record) noexcept
+    {
+        return reinterpret_cast<const std::byte*>(&record) + sizeof(lru_snapshot_record);
+    }
+
+    static const std::byte* value_bytes(const lru_snapshot_record& record) noexcept
+    {
+        return key_bytes(record) + align(record.key_size);
+    }
+
+    static void check(bool condition, const char* what)
+    {
+        if (!condition) {
+            throw std::runtime_error(std::string("lru_snapshot: ") + what);
+        }
+    }
+
+    // Records keep sizes in 32 bits
+    static uint32_t entry_size(std::size_t size)
+    {
+        check(size <= std::numeric_limits<uint32_t>::max(), "key or value of 4 GiB or more");
+        return static_cast<uint32_t>(size);
+    }
+
+    // Offsets and sizes read from the file are checked before they are followed,
+    // so a damaged or foreign file throws instead of reading past the records
+    const lru_snapshot_record& checked_record(uint64_t offset) const
+    {
+        uint64_t end = header_->index_offset;
+        check(offset >= sizeof(lru_snapshot_header) && offset % 8 == 0 && offset <= end
+                && end - offset >= sizeof(lru_snapshot_record),
+            "record is out of file");
+        const lru_snapshot_record& record = record_at(offset);
+        check(end - offset >= record_size(record.key_size, record.value_size), "record is out of file");
+        return record;
+    }
+
+public:
+    // Writes every entry visited by for_each(visit) with visit(key, value, deadline).
+    // for_each is called twice, to size the file and to fill it, and must visit the same
+    // entries in the same order both times. The file is written next to path and renamed
+    // over it when complete, so readers never see a partial snapshot
+    template <typename ForEach>
+    static void save(const std::filesystem::path& path, ForEach&& for_each, const Hash& hash = Hash())
+    {
+        uint64_t count        = 0;
+        uint64_t index_offset = sizeof(lru_snapshot_header);
+        for_each([&](const Key& key, const Value& value, clock::time_point) {
+            index_offset += record_size(entry_size(KeySerializer::size(key)), entry_size(ValueSerializer::size(value)));
+            ++count;
+        });
+        uint64_t index_size = std::bit_ceil(2 * count + 1);
+        uint64_t file_size  = index_offset + index_size * sizeof(lru_snapshot_slot);
+
+        std::filesystem::path temporary = path;
+        temporary += ".tmp";
+        try {
+            // Fresh file is zero filled, so every index slot starts free
+            std::ofstream(temporary, std::ios::binary | std::ios::trunc).close();
+            std::filesystem::resize_file(temporary, file_size);
+
+            boost::interprocess::file_mapping file(temporary.c_str(), boost::interprocess::read_write);
+            boost::interprocess::mapped_region region(file, boost::interprocess::read_write);
+            auto* data = static_cast<std::byte*>(region.get_address());
+
+            auto* header = reinterpret_cast<lru_snapshot_header*>(data);
+            std::memcpy(header->magic, lru_snapshot_header::expected_magic, sizeof(header->magic));
+            header->version      = lru_snapshot_header::current_version;
+            header->byte_order   = lru_snapshot_header::expected_byte_order;
+            header->count        = count;
+            header->index_offset = index_offset;
+            header->index_size   = index_size;
+            header->file_size    = file_size;
+
+            auto* index     = reinterpret_cast<lru_snapshot_slot*>(data + index_offset);
+            uint64_t offset = sizeof(lru_snapshot_header);
+            for_each([&](const Key& key, const Value& value, clock::time_point deadline) {
+                auto* record       = reinterpret_cast<lru_snapshot_record*>(data + offset);
+                record->deadline   = to_file(deadline);
+                record->key_size   = entry_size(KeySerializer::size(key));
+                record->value_size = entry_size(ValueSerializer::size(value));
+                KeySerializer::write(key, data + offset + sizeof(lru_snapshot_record));
+                ValueSerializer::write(value, data + offset + sizeof(lru_snapshot_record) + align(record->key_size));
+
+                uint64_t key_hash = hash(key);
+                std::size_t slot  = first_slot(key_hash, index_size);
+                while (index[slot].offset != 0) {
+                    slot = (slot + 1) & (index_size - 1);
+                }
+                index[slot] = { key_hash, offset };
+
+                offset += record_size(record->key_size, record->value_size);
+            });
+            check(offset == index_offset, "entries changed between passes");
+
+            region.flush();
+        } catch (...) {
+            std::filesystem::remove(temporary);
+            throw;
+        }
+        std::filesystem::rename(temporary, path);
+    }
+
+    // Maps the file read only, pages are read in by the first lookups that touch them
+    explicit lru_snapshot(const std::filesystem::path& path, Hash hash = Hash(), Equal equal = Equal())
+        : file_(path.c_str(), boost::interprocess::read_only)
+        , region_(file_, boost::interprocess::read_only)
+        , data_(static_cast<const std::byte*>(region_.get_address()))
+        , header_(reinterpret_cast<const lru_snapshot_header*>(data_))
+        , index_(nullptr)
+        , hash_(std::move(hash))
+        , equal_(std::move(equal))
+    {
+        check(region_.get_size() >= sizeof(lru_snapshot_header), "file is too short");
+        check(std::memcmp(header_->magic, lru_snapshot_header::expected_magic, sizeof(header_->magic)) == 0,
+            "not a snapshot");
+        check(header_->version == lru_snapshot_header::current_version, "unsupported version");
+        check(header_->byte_order == lru_snapshot_header::expected_byte_order, "byte order differs");
+        check(header_->file_size == region_.get_size(), "file is truncated");
+        check(std::has_single_bit(header_->index_size) && header_->index_size > header_->count,
+            "index size is not valid");
+        check(header_->index_offset >= sizeof(lru_snapshot_header)
+                && header_->index_size <= header_->file_size / sizeof(lru_snapshot_slot)
+                && header_->index_offset + header_->index_size * sizeof(lru_snapshot_slot) == header_->file_size,
+            "index is out of file");
+        index_ = reinterpret_cast<const lru_snapshot_slot*>(data_ + header_->index_offset);
+    }
+
+    lru_snapshot(const lru_snapshot&) = delete;
+
+    lru_snapshot& operator=(const lru_snapshot&) = delete;
+
+    // Includes entries that expired since the snapshot was taken
+    std::size_t size() const noexcept
+    {
+        return header_->count;
+    }
+
+    // Probes the index in place and deserializes only the value found. The probe
+    // stops after a full round, an index without free slots is not written by save()
+    std::optional<Value> get(const Key& key, clock::time_point now = clock::now()) const
+    {
+        uint64_t key_hash = hash_(key);
+        std::size_t slot  = first_slot(key_hash, header_->index_size);
+        for (uint64_t probes = 0; probes < header_->index_size && index_[slot].offset != 0;
+             ++probes, slot = (slot + 1) & (header_->index_size - 1)) {
+            if (index_[slot].hash != key_hash) {
+                continue;
+            }
+            // Keys are read back only when hashes match
+            const lru_snapshot_record& record = checked_record(index_[slot].offset);
+            if (!equal_(key, KeySerializer::read(key_bytes(record), record.key_size))) {
+                continue;
+            }
+            if (from_file(record.deadline) <= now) {
+                return std::nullopt;
+            }
+            return ValueSerializer::read(value_bytes(record), record.value_size);
+        }
+        return std::nullopt;
+    }
+
+    bool contains(const Key& key, clock::time_point now = clock::now()) const
+    {
+        return get(key, now).has_value();
+    }
+
+    // Calls visit(key, value, deadline) for every entry in eviction order, coldest first.
+    // Expired entries are visited too, the caller decides what to do with them
+    template <typename Visit>
+    void for_each(Visit&& visit) const
+    {
+        uint64_t offset = sizeof(lru_snapshot_header);
+        for (uint64_t i = 0; i < header_->count; ++i) {
+            const lru_snapshot_record& record = checked_record(offset);
+            visit(KeySerializer::read(key_bytes(record), record.key_size),
+                ValueSerializer::read(value_bytes(record), record.value_size), from_file(record.deadline));
+            offset += record_size(record.key_size, record.value_size);
+        }
+    }
+};
+
+// Writes live entries of map in eviction order to a snapshot file.
+// Remaining time to live is kept, the policy state beyond the order is not
+template <typename Map, typename KeySerializer = lru_serializer<typename Map::key_type>,
+    typename ValueSerializer = lru_serializer<typename Map::mapped_type>>
+void lru_save(const Map& map, const std::filesystem::path& path)
+{
+    using file = typename Map::template snapshot<KeySerializer, ValueSerializer>;
+
+    typename Map::clock::time_point now   = Map::clock::now();
+    typename file::clock::time_point wall = file::clock::now();
+    file::save(
+        path,
+        [&](auto&& visit) {
+            for (const auto& node : map.queues_) {
+                if (node.deadline() == Map::no_deadline) {
+                    visit(node.get_key(), node.get_value(), file::no_deadline);
+                } else if (!node.expired(now)) {
+                    visit(node.get_key(), node.get_value(),
+                        wall + std::chrono::duration_cast<typename file::clock::duration>(node.deadline() - now));
+                }
+            }
+        },
+        map.map_.hash_function());
+}
+
+// Replaces the contents of map with the live entries of the snapshot in a single pass.
+// Nodes and buckets are reserved once, entries beyond the budget evict the coldest ones.
+// The snapshot is only read, other threads may keep serving lookups from it meanwhile
+template <typename Map, typename Hash, typename Equal, typename KeySerializer, typename ValueSerializer>
+void lru_load(Map& map,
+    const lru_snapshot<typename Map::key_type, typename Map::mapped_type, Hash, Equal, KeySerializer, ValueSerializer>&
+        from)
+{
+    using file = lru_snapshot<typename Map::key_type, typename Map::mapped_type, Hash, Equal, KeySerializer,
+        ValueSerializer>;
+
+    map.clear();
+    map.reserve(from.size());
+
+    typename Map::clock::time_point now   = Map::clock::now();
+    typename file::clock::time_point wall = file::clock::now();
+    from.for_each([&](typename Map::key_type&& key, typename Map::mapped_type&& value,
+                      typename file::clock::time_point deadline) {
+        if (deadline == file::no_deadline) {
+            map.restore_node(std::move(key), std::move(value), Map::no_deadline);
+        } else if (deadline > wall) {
+            map.restore_node(std::move(key), std::move(value),
+                now + std::chrono::duration_cast<typename Map::clock::duration>(deadline - wall));
+        }
+    });
+}
+
+template <typename Map, typename KeySerializer = lru_serializer<typename Map::key_type>,
+    typename ValueSerializer = lru_serializer<typename Map::mapped_type>>
+void lru_load(Map& map, const std::filesystem::path& path)
+{
+    lru_load(map, typename Map::template snapshot<KeySerializer, ValueSerializer>(path));
+}
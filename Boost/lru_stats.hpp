@@ -0,0 +1,306 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Statistics policies for lru_map and lru_set.
+//
+// The container calls on(event) for every counted event, start() before and
+// on_latency(op, timer) after every contains()/put(), and collect(snapshot)
+// from stats(). lru_no_stats does nothing and compiles away, lru_stats keeps
+// plain counters for a single owner, lru_concurrent_stats keeps relaxed
+// atomics sharded per thread for maps read by many threads at once, like
+// peek() under a shared lock.
+
+enum class lru_event : std::size_t {
+    hit,
+    miss,
+    insert,
+    eviction,
+    expiration,
+    count_,
+};
+
+enum class lru_op : std::size_t {
+    contains,
+    put,
+    count_,
+};
+
+// Power of two buckets of nanoseconds, bucket i holds latencies below 2^i ns
+class lru_latency_histogram {
+public:
+    static constexpr std::size_t buckets = 40;
+
+    static std::size_t bucket_for(uint64_t ns) noexcept
+    {
+        return std::min<std::size_t>(std::bit_width(ns), buckets - 1);
+    }
+
+    void add(std::size_t bucket, uint64_t count = 1) noexcept
+    {
+        counts_[bucket] += count;
+    }
+
+    uint64_t count(std::size_t bucket) const noexcept
+    {
+        return counts_[bucket];
+    }
+
+    uint64_t total() const noexcept
+    {
+        uint64_t ret = 0;
+        for (uint64_t count : counts_) {
+            ret += count;
+        }
+        return ret;
+    }
+
+    // Upper bound of the bucket holding the p-th quantile, 0 when empty
+    uint64_t percentile(double p) const noexcept
+    {
+        uint64_t rank = static_cast<uint64_t>(p * total());
+        uint64_t seen = 0;
+        for (std::size_t bucket = 0; bucket < buckets; ++bucket) {
+            seen += counts_[bucket];
+            if (counts_[bucket] != 0 && seen > rank) {
+                return uint64_t { 1 } << bucket;
+            }
+        }
+        return 0;
+    }
+
+    lru_latency_histogram& operator+=(const lru_latency_histogram& other) noexcept
+    {
+        for (std::size_t bucket = 0; bucket < buckets; ++bucket) {
+            counts_[bucket] += other.counts_[bucket];
+        }
+        return *this;
+    }
+
+private:
+    std::array<uint64_t, buckets> counts_ {};
+};
+
+// Everything a container knows about itself at one moment
+struct lru_stats_snapshot {
+    // Chains of this length and longer share the last bucket
+    static constexpr std::size_t max_chain = 8;
+
+    std::array<uint64_t, static_cast<std::size_t>(lru_event::count_)> events {};
+    std::array<lru_latency_histogram, static_cast<std::size_t>(lru_op::count_)> latency {};
+
+    std::size_t size       = 0;
+    std::size_t weight     = 0;
+    std::size_t max_weight = 0;
+
+    // Lookups walk one bucket chain, so chain lengths are the probe lengths
+    std::size_t bucket_count = 0;
+    std::array<uint64_t, max_chain + 1> chain_lengths {};
+
+    uint64_t operator[](lru_event event) const noexcept
+    {
+        return events[static_cast<std::size_t>(event)];
+    }
+
+    const lru_latency_histogram& operator[](lru_op op) const noexcept
+    {
+        return latency[static_cast<std::size_t>(op)];
+    }
+
+    double hit_ratio() const noexcept
+    {
+        uint64_t lookups = (*this)[lru_event::hit] + (*this)[lru_event::miss];
+        return lookups == 0 ? 0.0 : static_cast<double>((*this)[lru_event::hit]) / lookups;
+    }
+
+    double load_factor() const noexcept
+    {
+        return bucket_count == 0 ? 0.0 : static_cast<double>(size) / bucket_count;
+    }
+
+    // Adds up snapshots of several containers, like the shards of one cache
+    lru_stats_snapshot& operator+=(const lru_stats_snapshot& other) noexcept
+    {
+        for (std::size_t i = 0; i < events.size(); ++i) {
+            events[i] += other.events[i];
+        }
+        for (std::size_t i = 0; i < latency.size(); ++i) {
+            latency[i] += other.latency[i];
+        }
+        size += other.size;
+        weight += other.weight;
+        max_weight += other.max_weight;
+        bucket_count += other.bucket_count;
+        for (std::size_t i = 0; i <= max_chain; ++i) {
+            chain_lengths[i] += other.chain_lengths[i];
+        }
+        return *this;
+    }
+
+    // Flat export for metrics scrapers, visit(name, value) per metric
+    template <typename Visitor>
+    void for_each_metric(Visitor&& visit) const
+    {
+        static constexpr std::array<std::string_view, static_cast<std::size_t>(lru_event::count_)> event_names {
+            "hits_total", "misses_total", "inserts_total", "evictions_total", "expirations_total"
+        };
+        for (std::size_t i = 0; i < events.size(); ++i) {
+            visit(event_names[i], static_cast<double>(events[i]));
+        }
+
+        static constexpr std::array<std::string_view, static_cast<std::size_t>(lru_op::count_) * 4> latency_names {
+            "contains_total", "contains_p50_ns", "contains_p99_ns", "contains_p999_ns", "put_total", "put_p50_ns",
+            "put_p99_ns", "put_p999_ns"
+        };
+        for (std::size_t i = 0; i < latency.size(); ++i) {
+            visit(latency_names[i * 4 + 0], static_cast<double>(latency[i].total()));
+            visit(latency_names[i * 4 + 1], static_cast<double>(latency[i].percentile(0.5)));
+            visit(latency_names[i * 4 + 2], static_cast<double>(latency[i].percentile(0.99)));
+            visit(latency_names[i * 4 + 3], static_cast<double>(latency[i].percentile(0.999)));
+        }
+
+        visit("hit_ratio", hit_ratio());
+        visit("size", static_cast<double>(size));
+        visit("weight", static_cast<double>(weight));
+        visit("max_weight", static_cast<double>(max_weight));
+        visit("bucket_count", static_cast<double>(bucket_count));
+        visit("load_factor", load_factor());
+
+        static constexpr std::array<std::string_view, max_chain + 1> chain_names { "chain_length_0", "chain_length_1",
+            "chain_length_2", "chain_length_3", "chain_length_4", "chain_length_5", "chain_length_6", "chain_length_7",
+            "chain_length_8_plus" };
+        for (std::size_t i = 0; i <= max_chain; ++i) {
+            visit(chain_names[i], static_cast<double>(chain_lengths[i]));
+        }
+    }
+};
+
+struct lru_no_stats {
+    struct timer { };
+
+    void on(lru_event) const noexcept
+    {
+    }
+
+    timer start() const noexcept
+    {
+        return {};
+    }
+
+    void on_latency(lru_op, timer) const noexcept
+    {
+    }
+
+    void collect(lru_stats_snapshot&) const noexcept
+    {
+    }
+};
+
+class lru_stats {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct timer {
+        clock::time_point start_;
+    };
+
+    void on(lru_event event) const noexcept
+    {
+        ++events_[static_cast<std::size_t>(event)];
+    }
+
+    timer start() const noexcept
+    {
+        return { clock::now() };
+    }
+
+    void on_latency(lru_op op, timer t) const noexcept
+    {
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t.start_).count();
+        latency_[static_cast<std::size_t>(op)].add(lru_latency_histogram::bucket_for(ns));
+    }
+
+    void collect(lru_stats_snapshot& snapshot) const noexcept
+    {
+        snapshot.events  = events_;
+        snapshot.latency = latency_;
+    }
+
+private:
+    // Lookups are const, counting them is not a change of the container
+    mutable std::array<uint64_t, static_cast<std::size_t>(lru_event::count_)> events_ {};
+    mutable std::array<lru_latency_histogram, static_cast<std::size_t>(lru_op::count_)> latency_ {};
+};
+
+class lru_concurrent_stats {
+public:
+    using clock = lru_stats::clock;
+    using timer = lru_stats::timer;
+
+    static constexpr std::size_t shards = 16;
+
+    void on(lru_event event) const noexcept
+    {
+        local().events_[static_cast<std::size_t>(event)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    timer start() const noexcept
+    {
+        return { clock::now() };
+    }
+
+    void on_latency(lru_op op, timer t) const noexcept
+    {
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t.start_).count();
+        local().latency_[static_cast<std::size_t>(op)][lru_latency_histogram::bucket_for(ns)].fetch_add(
+            1, std::memory_order_relaxed);
+    }
+
+    // Counters of a shard may move while it is read, totals are exact once writers stop
+    void collect(lru_stats_snapshot& snapshot) const noexcept
+    {
+        for (const shard& s : shards_) {
+            for (std::size_t i = 0; i < snapshot.events.size(); ++i) {
+                snapshot.events[i] += s.events_[i].load(std::memory_order_relaxed);
+            }
+            for (std::size_t op = 0; op < snapshot.latency.size(); ++op) {
+                for (std::size_t bucket = 0; bucket < lru_latency_histogram::buckets; ++bucket) {
+                    snapshot.latency[op].add(bucket, s.latency_[op][bucket].load(std::memory_order_relaxed));
+                }
+            }
+        }
+    }
+
+private:
+    // Padded to a cache line, so threads on different shards never share one
+    struct alignas(64) shard {
+        std::array<std::atomic<uint64_t>, static_cast<std::size_t>(lru_event::count_)> events_ {};
+        std::array<std::array<std::atomic<uint64_t>, lru_latency_histogram::buckets>,
+            static_cast<std::size_t>(lru_op::count_)>
+            latency_ {};
+    };
+
+    // Threads get shards round robin on first use, the same shard in every map
+    static std::size_t thread_shard() noexcept
+    {
+        static std::atomic<std::size_t> next { 0 };
+        thread_local std::size_t index = next.fetch_add(1, std::memory_order_relaxed) % shards;
+        return index;
+    }
+
+    shard& local() const noexcept
+    {
+        return shards_[thread_shard()];
+    }
+
+    mutable std::array<shard, shards> shards_ {};
+};
@@ -0,0 +1,166 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include <boost/intrusive/link_mode.hpp>
+#include <boost/intrusive/list.hpp>
+#include <boost/intrusive/list_hook.hpp>
+#include <boost/intrusive/options.hpp>
+
+struct lru_timer_tag;
+
+// Auto unlink lets a node leave its wheel slot without knowing which slot it is in
+using lru_timer_hook = boost::intrusive::list_base_hook<boost::intrusive::tag<lru_timer_tag>,
+    boost::intrusive::link_mode<boost::intrusive::auto_unlink>>;
+
+// Hierarchical timing wheel over intrusive nodes, in the style of the Linux kernel timers.
+//
+// Level 0 has one slot per tick, every next level has slots 64 times wider.
+// Scheduling and cancelling are O(1). Advancing jumps straight to the next
+// slot that may hold nodes, found from a bitmap per level, so idle time costs
+// nothing and every node is cascaded at most once per level. Deadlines are rounded up to
+// whole ticks, so a node is never expired early. Deadlines beyond the last
+// level are parked in its farthest slot and placed again when cascaded.
+//
+// Node derives from lru_timer_hook and has deadline() returning Clock::time_point.
+template <typename Node, typename Clock = std::chrono::steady_clock>
+class lru_timer_wheel {
+public:
+    using clock      = Clock;
+    using time_point = Clock::time_point;
+    using duration   = Clock::duration;
+
+    static constexpr std::size_t levels    = 4;
+    static constexpr std::size_t slot_bits = 6;
+    static constexpr std::size_t slots     = 1 << slot_bits;
+    static constexpr uint64_t slot_mask    = slots - 1;
+    static constexpr uint64_t max_delta    = uint64_t { 1 } << (slot_bits * levels);
+
+private:
+    using slot_list = boost::intrusive::list<Node, boost::intrusive::base_hook<lru_timer_hook>,
+        boost::intrusive::constant_time_size<false>>;
+
+    std::array<std::array<slot_list, slots>, levels> wheel_;
+    // Bit per slot that may be non empty, cancel() does not clear it
+    std::array<uint64_t, levels> occupied_;
+    time_point start_;
+    duration resolution_;
+    uint64_t now_;
+
+    uint64_t deadline_tick(time_point deadline) const noexcept
+    {
+        if (deadline <= start_) {
+            return 0;
+        }
+        return static_cast<uint64_t>((deadline - start_ + resolution_ - duration(1)) / resolution_);
+    }
+
+    void place(Node& node) noexcept
+    {
+        uint64_t tick = std::max(deadline_tick(node.deadline()), now_ + 1);
+        if (tick - now_ >= max_delta) {
+            tick = now_ + max_delta - 1;
+        }
+
+        std::size_t level = 0;
+        while ((tick - now_) >> (slot_bits * (level + 1)) != 0) {
+            ++level;
+        }
+        uint64_t index = (tick >> (slot_bits * level)) & slot_mask;
+        wheel_[level][index].push_back(node);
+        occupied_[level] |= uint64_t { 1 } << index;
+    }
+
+    slot_list& take(std::size_t level) noexcept
+    {
+        uint64_t index = (now_ >> (slot_bits * level)) & slot_mask;
+        occupied_[level] &= ~(uint64_t { 1 } << index);
+        return wheel_[level][index];
+    }
+
+    // Moves a slot of an upper level into the levels below
+    void cascade(std::size_t level) noexcept
+    {
+        slot_list pending;
+        pending.swap(take(level));
+        while (!pending.empty()) {
+            Node& node = pending.front();
+            pending.pop_front();
+            place(node);
+        }
+    }
+
+    // First tick after now that may have work, a level 0 slot to expire or an upper slot to cascade.
+    // Slots of a level at or before its current index belong to the next turn of that level,
+    // so they stop the search at the end of the current turn.
+    uint64_t next_tick() const noexcept
+    {
+        for (std::size_t level = 0; level < levels; ++level) {
+            std::size_t shift = slot_bits * level;
+            uint64_t turn     = now_ >> (shift + slot_bits);
+            uint64_t later    = occupied_[level] & (~uint64_t { 1 } << ((now_ >> shift) & slot_mask));
+            if (later != 0) {
+                return (turn << (shift + slot_bits)) | (static_cast<uint64_t>(std::countr_zero(later)) << shift);
+            }
+            if (occupied_[level] != 0) {
+                return (turn + 1) << (shift + slot_bits);
+            }
+        }
+        return std::numeric_limits<uint64_t>::max();
+    }
+
+public:
+    explicit lru_timer_wheel(duration resolution, time_point start = clock::now())
+        : wheel_()
+        , occupied_()
+        , start_(start)
+        , resolution_(resolution)
+        , now_(0)
+    {
+    }
+
+    lru_timer_wheel(const lru_timer_wheel&) = delete;
+
+    lru_timer_wheel& operator=(const lru_timer_wheel&) = delete;
+
+    void schedule(Node& node) noexcept
+    {
+        node.lru_timer_hook::unlink();
+        place(node);
+    }
+
+    void cancel(Node& node) noexcept
+    {
+        node.lru_timer_hook::unlink();
+    }
+
+    // Calls expire(node) for every node with deadline up to now, the node is
+    // already unlinked from the wheel and may be destroyed by the callback
+    template <typename Expire>
+    void advance(time_point now, Expire&& expire)
+    {
+        uint64_t target = now <= start_ ? 0 : static_cast<uint64_t>((now - start_) / resolution_);
+        while (now_ < target) {
+            now_ = std::min(next_tick(), target);
+            for (std::size_t level = 1; level < levels && (now_ & ((uint64_t { 1 } << (slot_bits * level)) - 1)) == 0;
+                 ++level) {
+                cascade(level);
+            }
+
+            slot_list& due = take(0);
+            while (!due.empty()) {
+                Node& node = due.front();
+                due.pop_front();
+                expire(node);
+            }
+        }
+    }
+};
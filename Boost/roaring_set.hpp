@@ -0,0 +1,787 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <utility>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+#include <boost/container/small_vector.hpp>
+#include <boost/smart_ptr/intrusive_ptr.hpp>
+#include <boost/smart_ptr/intrusive_ref_counter.hpp>
+
+// Compressed set of 32 bit ids in the style of Roaring bitmaps, a drop in codomain
+// for boost::icl::interval_map in place of flat_set<uint32_t>.
+//
+// Ids are split by their high 16 bits into chunks. A chunk stores the low 16 bits
+// as a sorted array, 2 bytes per id, or once it holds more than 4096 ids as a
+// bitmap of 65536 bits, which is never larger than the array would be.
+//
+// Chunk contents are reference counted blocks shared between sets. Copying a set,
+// which interval_map does for every segment it splits, copies only the chunk list,
+// a change clones the blocks it touches. Set operations reuse blocks both sides
+// share instead of comparing them.
+class roaring_set {
+public:
+    using value_type      = uint32_t;
+    using key_type        = uint32_t;
+    using size_type       = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference       = uint32_t;
+    using const_reference = uint32_t;
+
+private:
+    static constexpr uint32_t max_array = 4096;
+    static constexpr std::size_t words  = 65536 / 64;
+    static constexpr std::size_t lanes  = 8;
+
+    // Header of the ids of one chunk, which follow it in the same allocation: capacity_
+    // sorted low halves for an array, or the words of a bitmap when capacity_ is 0
+    struct alignas(uint64_t) block : boost::intrusive_ref_counter<block> {
+        uint32_t cardinality_ = 0;
+        uint32_t capacity_    = 0;
+
+        bool is_bitmap() const noexcept
+        {
+            return capacity_ == 0;
+        }
+
+        uint16_t* values() noexcept
+        {
+            return reinterpret_cast<uint16_t*>(this + 1);
+        }
+
+        const uint16_t* values() const noexcept
+        {
+            return reinterpret_cast<const uint16_t*>(this + 1);
+        }
+
+        uint64_t* bits() noexcept
+        {
+            return reinterpret_cast<uint64_t*>(this + 1);
+        }
+
+        const uint64_t* bits() const noexcept
+        {
+            return reinterpret_cast<const uint64_t*>(this + 1);
+        }
+
+        std::size_t bytes() const noexcept
+        {
+            return sizeof(block) + (is_bitmap() ? words * sizeof(uint64_t) : capacity_ * sizeof(uint16_t));
+        }
+
+        // Storage comes from make_block()
+        static void operator delete(void* pointer) noexcept
+        {
+            ::operator delete(pointer);
+        }
+    };
+
+    using block_ptr = boost::intrusive_ptr<block>;
+
+    struct chunk {
+        uint16_t high_;
+        block_ptr block_;
+    };
+
+    // Most sets of small ids fit in one chunk, which then needs no allocation of its own
+    using chunks = boost::container::small_vector<chunk, 1>;
+
+    chunks chunks_;
+
+    // Empty array with room for capacity ids, or a bitmap with no bits set when capacity is 0
+    static block_ptr make_block(uint32_t capacity)
+    {
+        std::size_t bytes = capacity == 0 ? words * sizeof(uint64_t) : capacity * sizeof(uint16_t);
+        block* ret        = new (::operator new(sizeof(block) + bytes)) block();
+        ret->capacity_    = capacity;
+        if (capacity == 0) {
+            std::memset(ret->bits(), 0, bytes);
+        }
+        return block_ptr(ret);
+    }
+
+    static block_ptr copy_of(const block& b)
+    {
+        block_ptr ret     = make_block(b.capacity_);
+        ret->cardinality_ = b.cardinality_;
+        if (b.is_bitmap()) {
+            std::memcpy(ret->bits(), b.bits(), words * sizeof(uint64_t));
+        } else {
+            std::memcpy(ret->values(), b.values(), b.cardinality_ * sizeof(uint16_t));
+        }
+        return ret;
+    }
+
+    static block_ptr bitmap_of(const block& b)
+    {
+        if (b.is_bitmap()) {
+            return copy_of(b);
+        }
+        block_ptr ret     = make_block(0);
+        ret->cardinality_ = b.cardinality_;
+        for (uint32_t i = 0; i < b.cardinality_; ++i) {
+            ret->bits()[b.values()[i] / 64] |= uint64_t { 1 } << (b.values()[i] % 64);
+        }
+        return ret;
+    }
+
+    static block_ptr array_of(const block& b)
+    {
+        block_ptr ret     = make_block(b.cardinality_);
+        ret->cardinality_ = b.cardinality_;
+        uint16_t* out     = ret->values();
+        for (std::size_t i = 0; i < words; ++i) {
+            for (uint64_t word = b.bits()[i]; word != 0; word &= word - 1) {
+                *out++ = static_cast<uint16_t>(i * 64 + std::countr_zero(word));
+            }
+        }
+        return ret;
+    }
+
+    static bool test(const block& b, uint16_t low) noexcept
+    {
+        if (b.is_bitmap()) {
+            return b.bits()[low / 64] >> (low % 64) & 1;
+        }
+        return std::binary_search(b.values(), b.values() + b.cardinality_, low);
+    }
+
+    static uint32_t count_bits(const uint64_t* bits) noexcept
+    {
+        uint32_t count = 0;
+        for (std::size_t i = 0; i < words; ++i) {
+            count += std::popcount(bits[i]);
+        }
+        return count;
+    }
+
+    // Every block is a bitmap exactly when it holds more than max_array ids, so equal
+    // blocks have equal representations. Empty blocks are dropped
+    static block_ptr finish(block_ptr b)
+    {
+        if (b->cardinality_ == 0) {
+            return nullptr;
+        }
+        if (b->is_bitmap() && b->cardinality_ <= max_array) {
+            return array_of(*b);
+        }
+        if (!b->is_bitmap() && b->cardinality_ > max_array) {
+            return bitmap_of(*b);
+        }
+        return b;
+    }
+
+    // Copies the ids of a found in b when keep, or missing from b otherwise, into out.
+    // Both arrays are sorted. With SSE4.2 eight ids of a are compared against eight of
+    // b in one instruction, the matches of one a block accumulate over the b blocks
+    // it overlaps and are written out once a moves past it
+    template <bool keep>
+    static uint32_t filter_sorted(const uint16_t* a, uint32_t a_size, const uint16_t* b, uint32_t b_size, uint16_t* out)
+    {
+        uint32_t count = 0;
+        uint32_t i     = 0;
+        uint32_t j     = 0;
+
+        // Looking every id up is cheaper than walking a much larger b
+        if (b_size > 64 * a_size) {
+            for (; i < a_size; ++i) {
+                j = std::lower_bound(b + j, b + b_size, a[i]) - b;
+                if ((j < b_size && b[j] == a[i]) == keep) {
+                    out[count++] = a[i];
+                }
+            }
+            return count;
+        }
+
+#if defined(__SSE4_2__)
+        uint32_t a_end = a_size / lanes * lanes;
+        uint32_t b_end = b_size / lanes * lanes;
+        if (a_end > 0 && b_end > 0) {
+            __m128i a_lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+            __m128i b_lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+            uint32_t found  = 0;
+            while (true) {
+                // Bit k is set when a[i + k] equals any of b[j] ... b[j + 7]
+                found |= _mm_cvtsi128_si32(_mm_cmpestrm(
+                    b_lanes, lanes, a_lanes, lanes, _SIDD_UWORD_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK));
+                uint16_t a_max = a[i + lanes - 1];
+                uint16_t b_max = b[j + lanes - 1];
+                if (a_max <= b_max) {
+                    for (uint32_t mask = keep ? found : ~found & 0xff; mask != 0; mask &= mask - 1) {
+                        out[count++] = a[i + std::countr_zero(mask)];
+                    }
+                    found = 0;
+                    i += lanes;
+                    if (i == a_end) {
+                        break;
+                    }
+                    a_lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+                }
+                if (b_max <= a_max) {
+                    j += lanes;
+                    if (j == b_end) {
+                        break;
+                    }
+                    b_lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+                }
+            }
+            // b ran out of whole blocks in the middle of an a block, the rest of b is short
+            if (i < a_end) {
+                for (uint32_t k = i; k < i + lanes; ++k) {
+                    bool in_b = (found >> (k - i) & 1) || std::binary_search(b + j, b + b_size, a[k]);
+                    if (in_b == keep) {
+                        out[count++] = a[k];
+                    }
+                }
+                i += lanes;
+            }
+        }
+#endif
+
+        while (i < a_size && j < b_size) {
+            if (a[i] < b[j]) {
+                if (!keep) {
+                    out[count++] = a[i];
+                }
+                ++i;
+            } else if (b[j] < a[i]) {
+                ++j;
+            } else {
+                if (keep) {
+                    out[count++] = a[i];
+                }
+                ++i;
+                ++j;
+            }
+        }
+        if (!keep) {
+            for (; i < a_size; ++i) {
+                out[count++] = a[i];
+            }
+        }
+        return count;
+    }
+
+    // Keeps the ids of the array a found in b when keep, or missing from it otherwise
+    template <bool keep>
+    static block_ptr filter_array(const block& a, const block& b)
+    {
+        block_ptr ret = make_block(a.cardinality_);
+        if (b.is_bitmap()) {
+            for (uint32_t i = 0; i < a.cardinality_; ++i) {
+                if (test(b, a.values()[i]) == keep) {
+                    ret->values()[ret->cardinality_++] = a.values()[i];
+                }
+            }
+        } else {
+            ret->cardinality_
+                = filter_sorted<keep>(a.values(), a.cardinality_, b.values(), b.cardinality_, ret->values());
+        }
+        return finish(std::move(ret));
+    }
+
+    // Word loops over two bitmaps are plain enough for the compiler to vectorize
+    static block_ptr unite(const block& a, const block& b)
+    {
+        if (!a.is_bitmap() && !b.is_bitmap() && a.cardinality_ + b.cardinality_ <= max_array) {
+            block_ptr ret     = make_block(a.cardinality_ + b.cardinality_);
+            uint16_t* end     = std::set_union(
+                a.values(), a.values() + a.cardinality_, b.values(), b.values() + b.cardinality_, ret->values());
+            ret->cardinality_ = end - ret->values();
+            return ret;
+        }
+
+        block_ptr ret = bitmap_of(a);
+        if (b.is_bitmap()) {
+            for (std::size_t i = 0; i < words; ++i) {
+                ret->bits()[i] |= b.bits()[i];
+            }
+        } else {
+            for (uint32_t i = 0; i < b.cardinality_; ++i) {
+                ret->bits()[b.values()[i] / 64] |= uint64_t { 1 } << (b.values()[i] % 64);
+            }
+        }
+        ret->cardinality_ = count_bits(ret->bits());
+        return finish(std::move(ret));
+    }
+
+    static block_ptr intersect(const block& a, const block& b)
+    {
+        if (!a.is_bitmap()) {
+            return filter_array<true>(a, b);
+        }
+        if (!b.is_bitmap()) {
+            return filter_array<true>(b, a);
+        }
+        block_ptr ret = copy_of(a);
+        for (std::size_t i = 0; i < words; ++i) {
+            ret->bits()[i] &= b.bits()[i];
+        }
+        ret->cardinality_ = count_bits(ret->bits());
+        return finish(std::move(ret));
+    }
+
+    static block_ptr subtract(const block& a, const block& b)
+    {
+        if (!a.is_bitmap()) {
+            return filter_array<false>(a, b);
+        }
+        block_ptr ret = copy_of(a);
+        if (b.is_bitmap()) {
+            for (std::size_t i = 0; i < words; ++i) {
+                ret->bits()[i] &= ~b.bits()[i];
+            }
+        } else {
+            for (uint32_t i = 0; i < b.cardinality_; ++i) {
+                ret->bits()[b.values()[i] / 64] &= ~(uint64_t { 1 } << (b.values()[i] % 64));
+            }
+        }
+        ret->cardinality_ = count_bits(ret->bits());
+        return finish(std::move(ret));
+    }
+
+    static bool equal_blocks(const block& a, const block& b) noexcept
+    {
+        if (a.cardinality_ != b.cardinality_) {
+            return false;
+        }
+        if (a.is_bitmap()) {
+            return std::memcmp(a.bits(), b.bits(), words * sizeof(uint64_t)) == 0;
+        }
+        return std::memcmp(a.values(), b.values(), a.cardinality_ * sizeof(uint16_t)) == 0;
+    }
+
+    // Returns false when low was in b already. b must not be shared, it is replaced
+    // when the array has to grow or turn into a bitmap
+    static bool add_low(block_ptr& b, uint16_t low)
+    {
+        if (b->is_bitmap()) {
+            uint64_t& word = b->bits()[low / 64];
+            uint64_t bit   = uint64_t { 1 } << (low % 64);
+            if (word & bit) {
+                return false;
+            }
+            word |= bit;
+            ++b->cardinality_;
+            return true;
+        }
+
+        // Ids are usually handed out in ascending order, so the new one goes last
+        uint16_t* first = b->values();
+        uint16_t* last  = first + b->cardinality_;
+        uint16_t* it    = last[-1] < low ? last : std::lower_bound(first, last, low);
+        if (it != last && *it == low) {
+            return false;
+        }
+        if (b->cardinality_ == max_array) {
+            b = bitmap_of(*b);
+            return add_low(b, low);
+        }
+        if (b->cardinality_ == b->capacity_) {
+            block_ptr grown     = make_block(std::min(max_array, b->capacity_ + b->capacity_ / 2 + 4));
+            uint16_t* out       = std::copy(first, it, grown->values());
+            *out                = low;
+            std::copy(it, last, out + 1);
+            grown->cardinality_ = b->cardinality_ + 1;
+            b                   = std::move(grown);
+            return true;
+        }
+        std::copy_backward(it, last, last + 1);
+        *it = low;
+        ++b->cardinality_;
+        return true;
+    }
+
+    // Returns false when low was not in b. b must not be shared, it may be left empty
+    static bool remove_low(block_ptr& b, uint16_t low)
+    {
+        if (b->is_bitmap()) {
+            uint64_t& word = b->bits()[low / 64];
+            uint64_t bit   = uint64_t { 1 } << (low % 64);
+            if (!(word & bit)) {
+                return false;
+            }
+            word &= ~bit;
+            if (--b->cardinality_ == max_array) {
+                b = array_of(*b);
+            }
+            return true;
+        }
+
+        uint16_t* first = b->values();
+        uint16_t* last  = first + b->cardinality_;
+        uint16_t* it    = std::lower_bound(first, last, low);
+        if (it == last || *it != low) {
+            return false;
+        }
+        std::copy(it + 1, last, it);
+        --b->cardinality_;
+        return true;
+    }
+
+    // interval_map adds and subtracts sets of one or a few ids, which can go into or
+    // out of a block no other set holds without building a new one
+    static bool patch_in_place(const block_ptr& a, const block_ptr& b) noexcept
+    {
+        return a->use_count() == 1 && !b->is_bitmap() && b->cardinality_ <= lanes;
+    }
+
+    // Clones a block shared with another set before it is changed in place
+    static block_ptr& writable(chunk& c)
+    {
+        if (c.block_->use_count() > 1) {
+            c.block_ = copy_of(*c.block_);
+        }
+        return c.block_;
+    }
+
+    chunks::iterator find_chunk(uint16_t high) noexcept
+    {
+        return std::lower_bound(
+            chunks_.begin(), chunks_.end(), high, [](const chunk& c, uint16_t key) { return c.high_ < key; });
+    }
+
+    chunks::const_iterator find_chunk(uint16_t high) const noexcept
+    {
+        return std::lower_bound(
+            chunks_.begin(), chunks_.end(), high, [](const chunk& c, uint16_t key) { return c.high_ < key; });
+    }
+
+    // Walks both chunk lists in order of high bits. Chunks found in only one of the sets
+    // are kept when keep_own or keep_other says so, for chunks in both combine(a, b)
+    // replaces block a, which is dropped when left null. Must not be given *this
+    template <typename Combine>
+    void merge_chunks(const roaring_set& other, bool keep_own, bool keep_other, Combine combine)
+    {
+        // The set of a single chunk an interval_map adds or subtracts is merged in place
+        if (keep_own && other.chunks_.size() == 1) {
+            const chunk& c = other.chunks_.front();
+            auto it        = find_chunk(c.high_);
+            if (it == chunks_.end() || it->high_ != c.high_) {
+                if (keep_other) {
+                    chunks_.insert(it, c);
+                }
+            } else {
+                combine(it->block_, c.block_);
+                if (!it->block_) {
+                    chunks_.erase(it);
+                }
+            }
+            return;
+        }
+
+        chunks ret;
+        auto a = chunks_.begin();
+        auto b = other.chunks_.begin();
+        while (a != chunks_.end() && b != other.chunks_.end()) {
+            if (a->high_ < b->high_) {
+                if (keep_own) {
+                    ret.push_back(*a);
+                }
+                ++a;
+            } else if (b->high_ < a->high_) {
+                if (keep_other) {
+                    ret.push_back(*b);
+                }
+                ++b;
+            } else {
+                // Moved out, so a block only this set holds can be changed in place
+                block_ptr combined = std::move(a->block_);
+                combine(combined, b->block_);
+                if (combined) {
+                    ret.push_back({ a->high_, std::move(combined) });
+                }
+                ++a;
+                ++b;
+            }
+        }
+        if (keep_own) {
+            ret.insert(ret.end(), a, chunks_.end());
+        }
+        if (keep_other) {
+            ret.insert(ret.end(), b, other.chunks_.end());
+        }
+        chunks_.swap(ret);
+    }
+
+public:
+    // Ids in ascending order
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = uint32_t;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const uint32_t*;
+        using reference         = uint32_t;
+
+        const_iterator() = default;
+
+        const_iterator(const roaring_set* set, std::size_t index)
+            : set_(set)
+            , chunk_(index)
+        {
+            skip_empty_words();
+        }
+
+        uint32_t operator*() const noexcept
+        {
+            const chunk& c = set_->chunks_[chunk_];
+            uint32_t low   = c.block_->is_bitmap() ? position_ * 64 + std::countr_zero(word_)
+                                                   : c.block_->values()[position_];
+            return uint32_t { c.high_ } << 16 | low;
+        }
+
+        const_iterator& operator++() noexcept
+        {
+            const block& b = *set_->chunks_[chunk_].block_;
+            if (b.is_bitmap()) {
+                word_ &= word_ - 1;
+                if (word_ == 0) {
+                    ++position_;
+                    skip_empty_words();
+                }
+            } else if (++position_ == b.cardinality_) {
+                ++chunk_;
+                position_ = 0;
+                skip_empty_words();
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int) noexcept
+        {
+            const_iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        bool operator==(const const_iterator& other) const noexcept
+        {
+            return chunk_ == other.chunk_ && position_ == other.position_ && word_ == other.word_;
+        }
+
+    private:
+        const roaring_set* set_ = nullptr;
+        std::size_t chunk_      = 0;
+        // Index into the array, or of the current word of a bitmap
+        uint32_t position_ = 0;
+        // Bits of the current word not visited yet
+        uint64_t word_ = 0;
+
+        // In a bitmap moves to the next word with a bit set, leaving for the next chunk when there is none
+        void skip_empty_words() noexcept
+        {
+            while (chunk_ < set_->chunks_.size() && set_->chunks_[chunk_].block_->is_bitmap()) {
+                const uint64_t* bits = set_->chunks_[chunk_].block_->bits();
+                for (; position_ < words; ++position_) {
+                    if ((word_ = bits[position_]) != 0) {
+                        return;
+                    }
+                }
+                ++chunk_;
+                position_ = 0;
+            }
+            word_ = 0;
+        }
+    };
+
+    using iterator = const_iterator;
+
+    roaring_set() = default;
+
+    template <typename InputIt>
+    roaring_set(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+    }
+
+    roaring_set(std::initializer_list<uint32_t> ids)
+        : roaring_set(ids.begin(), ids.end())
+    {
+    }
+
+    const_iterator begin() const noexcept
+    {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const noexcept
+    {
+        return const_iterator(this, chunks_.size());
+    }
+
+    bool empty() const noexcept
+    {
+        return chunks_.empty();
+    }
+
+    std::size_t size() const noexcept
+    {
+        std::size_t ret = 0;
+        for (const chunk& c : chunks_) {
+            ret += c.block_->cardinality_;
+        }
+        return ret;
+    }
+
+    void clear() noexcept
+    {
+        chunks_.clear();
+    }
+
+    bool contains(uint32_t id) const noexcept
+    {
+        auto it = find_chunk(id >> 16);
+        return it != chunks_.end() && it->high_ == id >> 16 && test(*it->block_, id & 0xffff);
+    }
+
+    // Returns false when id was in the set already
+    bool insert(uint32_t id)
+    {
+        uint16_t high = id >> 16;
+        uint16_t low  = id & 0xffff;
+        auto it       = find_chunk(high);
+        if (it == chunks_.end() || it->high_ != high) {
+            block_ptr b     = make_block(1);
+            b->values()[0]  = low;
+            b->cardinality_ = 1;
+            chunks_.insert(it, chunk { high, std::move(b) });
+            return true;
+        }
+        if (test(*it->block_, low)) {
+            return false;
+        }
+        return add_low(writable(*it), low);
+    }
+
+    // Returns the number of ids removed, 0 or 1
+    std::size_t erase(uint32_t id)
+    {
+        uint16_t high = id >> 16;
+        uint16_t low  = id & 0xffff;
+        auto it       = find_chunk(high);
+        if (it == chunks_.end() || it->high_ != high || !test(*it->block_, low)) {
+            return 0;
+        }
+        if (it->block_->cardinality_ == 1) {
+            chunks_.erase(it);
+            return 1;
+        }
+        return remove_low(writable(*it), low);
+    }
+
+    // Union
+    roaring_set& operator+=(const roaring_set& other)
+    {
+        if (chunks_.empty()) {
+            chunks_ = other.chunks_;
+            return *this;
+        }
+        if (this == &other) {
+            return *this;
+        }
+        merge_chunks(other, true, true, [](block_ptr& a, const block_ptr& b) {
+            if (a == b) {
+                return;
+            }
+            if (!patch_in_place(a, b)) {
+                a = unite(*a, *b);
+                return;
+            }
+            for (uint32_t i = 0; i < b->cardinality_; ++i) {
+                add_low(a, b->values()[i]);
+            }
+        });
+        return *this;
+    }
+
+    // Difference
+    roaring_set& operator-=(const roaring_set& other)
+    {
+        if (this == &other) {
+            clear();
+            return *this;
+        }
+        merge_chunks(other, true, false, [](block_ptr& a, const block_ptr& b) {
+            if (a == b) {
+                a.reset();
+                return;
+            }
+            if (!patch_in_place(a, b)) {
+                a = subtract(*a, *b);
+                return;
+            }
+            for (uint32_t i = 0; i < b->cardinality_; ++i) {
+                remove_low(a, b->values()[i]);
+            }
+            if (a->cardinality_ == 0) {
+                a.reset();
+            }
+        });
+        return *this;
+    }
+
+    // Intersection
+    roaring_set& operator&=(const roaring_set& other)
+    {
+        if (this == &other) {
+            return *this;
+        }
+        merge_chunks(other, false, false, [](block_ptr& a, const block_ptr& b) {
+            if (a != b) {
+                a = intersect(*a, *b);
+            }
+        });
+        return *this;
+    }
+
+    friend roaring_set operator+(roaring_set a, const roaring_set& b)
+    {
+        return a += b;
+    }
+
+    friend roaring_set operator-(roaring_set a, const roaring_set& b)
+    {
+        return a -= b;
+    }
+
+    friend roaring_set operator&(roaring_set a, const roaring_set& b)
+    {
+        return a &= b;
+    }
+
+    friend bool operator==(const roaring_set& a, const roaring_set& b) noexcept
+    {
+        return std::equal(a.chunks_.begin(), a.chunks_.end(), b.chunks_.begin(), b.chunks_.end(),
+            [](const chunk& x, const chunk& y) {
+                return x.high_ == y.high_ && (x.block_ == y.block_ || equal_blocks(*x.block_, *y.block_));
+            });
+    }
+
+    // Heap and inline bytes of the set, blocks shared with other sets are counted in full
+    std::size_t memory_usage() const noexcept
+    {
+        std::size_t bytes = sizeof(*this);
+        if (chunks_.capacity() > 1) {
+            bytes += chunks_.capacity() * sizeof(chunk);
+        }
+        for (const chunk& c : chunks_) {
+            bytes += c.block_->bytes();
+        }
+        return bytes;
+    }
+};
@@ -5,13 +5,15 @@
 #include <boost/msm/back/state_machine.hpp>
 #include <boost/msm/front/state_machine_def.hpp>
 
+#include "table_state_machine.hpp"
+
 namespace msm = boost::msm;
 namespace mpl = boost::mpl;
 
 template <typename T>
 void print(const T& t)
 {
-    std::cout << t << std::endl;
+    std::cout << t << '\n';
 }
 
 struct turn_on {
@@ -132,10 +134,17 @@ struct lamp_ : public msm::front::state_machine_def<lamp_> {
 // Pick a back-end
 using lamp = msm::back::state_machine<lamp_>;
 
-int main()
+// Same front-end on a jump table, the state is one byte plus room for 4 deferred events
+using table_lamp = table_state_machine<lamp_, 4>;
+
+// Same again, recording every event it dispatches in a ring of the thread
+using traced_lamp = table_state_machine<lamp_, 4, fsm_ring_trace<>>;
+
+template <typename Lamp>
+void run()
 {
     { // Simple transitions
-        lamp p;
+        Lamp p;
         p.start();
 
         p.process_event(turn_on { .hot = true });
@@ -147,7 +156,7 @@ int main()
         p.stop();
     }
     { // Deffered events
-        lamp p;
+        Lamp p;
         p.start();
 
         p.process_event(turn_on { .hot = true });
@@ -156,5 +165,20 @@ int main()
 
         p.stop();
     }
+}
+
+int main()
+{
+    run<lamp>();
+
+    print("");
+    run<table_lamp>();
+
+    print("");
+    run<traced_lamp>();
+
+    print("");
+    fsm_trace_dump(std::cout, fsm_ring_trace<>::collect());
+
     return 0;
 }
@@ -0,0 +1,376 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <variant>
+
+#include <boost/integer.hpp>
+#include <boost/mp11/algorithm.hpp>
+#include <boost/mp11/list.hpp>
+#include <boost/mpl/fold.hpp>
+#include <boost/mpl/is_sequence.hpp>
+#include <boost/msm/back/common_types.hpp>
+#include <boost/msm/front/state_machine_def.hpp>
+#include <boost/msm/row_tags.hpp>
+
+#include "fsm_trace.hpp"
+
+// Back-end for the front-ends of boost::msm::back::state_machine, meant for
+// millions of small machines.
+//
+// The transition table is turned at compile time into a dense constexpr table
+// with a handler for every state and event, process_event() is one indexed
+// call. An instance holds the current state as the smallest integer that fits
+// and, when its states defer events, a ring of at most DeferCapacity of them.
+//
+// Covers flat machines: one region, row, a_row, g_row, _row and their internal
+// versions, or the functor rows of the same shape. States are entered and left
+// as fresh temporaries, data they hold does not outlive the call. Rows matching
+// the same state and event are tried last first, like MSM does. Actions must not
+// call process_event(), there is no queue for events raised while handling one.
+//
+// Trace is a policy of fsm_trace.hpp told about every dispatched event.
+
+// MPL sequence as an mp11 list
+struct fsm_push_back {
+    template <typename List, typename T>
+    struct apply {
+        using type = boost::mp11::mp_push_back<List, T>;
+    };
+};
+
+template <typename Sequence>
+using fsm_list = typename boost::mpl::fold<Sequence, boost::mp11::mp_list<>, fsm_push_back>::type;
+
+// Fixed size FIFO of deferred events of any of the types in Variant
+template <typename Variant, std::size_t Capacity>
+class fsm_deferred_ring {
+public:
+    bool empty() const noexcept
+    {
+        return size_ == 0;
+    }
+
+    bool full() const noexcept
+    {
+        return size_ == Capacity;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    template <typename Event>
+    void push(const Event& event)
+    {
+        events_[(head_ + size_) % Capacity] = event;
+        ++size_;
+    }
+
+    Variant pop()
+    {
+        Variant event = std::move(events_[head_]);
+        head_         = (head_ + 1) % Capacity;
+        --size_;
+        return event;
+    }
+
+    void clear() noexcept
+    {
+        head_ = 0;
+        size_ = 0;
+    }
+
+private:
+    using index = typename boost::uint_value_t<Capacity>::least;
+
+    std::array<Variant, Capacity> events_ {};
+    index head_ = 0;
+    index size_ = 0;
+};
+
+template <typename Variant>
+class fsm_deferred_ring<Variant, 0> {
+public:
+    bool empty() const noexcept
+    {
+        return true;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return 0;
+    }
+
+    void clear() noexcept
+    {
+    }
+};
+
+template <typename Front, std::size_t DeferCapacity = 0, typename Trace = fsm_no_trace>
+class table_state_machine : public Front {
+    template <typename Row>
+    using source_of = typename Row::Source;
+
+    template <typename Row>
+    using target_of = typename Row::Target;
+
+    template <typename Row>
+    using event_of = typename Row::Evt;
+
+    template <typename State>
+    using deferred_of = fsm_list<typename State::deferred_events>;
+
+    template <typename Row, typename... Tags>
+    static constexpr bool tagged = (std::is_same_v<typename Row::row_type_tag, Tags> || ...);
+
+    template <typename Row>
+    static constexpr bool has_action
+        = tagged<Row, boost::msm::row_tag, boost::msm::a_row_tag, boost::msm::irow_tag, boost::msm::a_irow_tag>;
+
+    template <typename Row>
+    static constexpr bool has_guard
+        = tagged<Row, boost::msm::row_tag, boost::msm::g_row_tag, boost::msm::irow_tag, boost::msm::g_irow_tag>;
+
+    template <typename Row>
+    static constexpr bool is_internal
+        = tagged<Row, boost::msm::irow_tag, boost::msm::a_irow_tag, boost::msm::g_irow_tag, boost::msm::_irow_tag>;
+
+    // initial_state is a state or one per region
+    using initial_states = boost::mp11::mp_eval_if_c<!boost::mpl::is_sequence<typename Front::initial_state>::value,
+        boost::mp11::mp_list<typename Front::initial_state>, fsm_list, typename Front::initial_state>;
+    static_assert(boost::mp11::mp_size<initial_states>::value == 1, "table_state_machine supports a single region");
+
+    using initial = boost::mp11::mp_front<initial_states>;
+
+    using rows = fsm_list<typename Front::transition_table>;
+
+public:
+    // Initial state first, so it has id 0
+    using states = boost::mp11::mp_unique<boost::mp11::mp_append<boost::mp11::mp_list<initial>,
+        boost::mp11::mp_transform<source_of, rows>, boost::mp11::mp_transform<target_of, rows>>>;
+    using deferred_events
+        = boost::mp11::mp_unique<boost::mp11::mp_flatten<boost::mp11::mp_transform<deferred_of, states>>>;
+    using events
+        = boost::mp11::mp_unique<boost::mp11::mp_append<boost::mp11::mp_transform<event_of, rows>, deferred_events>>;
+    using state_id = typename boost::uint_value_t<boost::mp11::mp_size<states>::value - 1>::least;
+
+    static constexpr std::size_t state_count = boost::mp11::mp_size<states>::value;
+    static constexpr std::size_t event_count = boost::mp11::mp_size<events>::value;
+
+    template <typename State>
+    static constexpr state_id id_of = boost::mp11::mp_find<states, State>::value;
+
+private:
+    static constexpr std::size_t defer_capacity = boost::mp11::mp_empty<deferred_events>::value ? 0 : DeferCapacity;
+
+    using deferred_ring = fsm_deferred_ring<boost::mp11::mp_rename<deferred_events, std::variant>, defer_capacity>;
+    using handler       = boost::msm::back::HandledEnum (*)(table_state_machine&, const void*);
+
+    state_id state_ = 0;
+    [[no_unique_address]] deferred_ring deferred_;
+    [[no_unique_address]] Trace trace_;
+
+    template <typename Row>
+    static constexpr bool flat_row = has_action<Row> || has_guard<Row> || is_internal<Row>
+        || std::is_same_v<typename Row::row_type_tag, boost::msm::_row_tag>;
+
+    template <typename State, typename Event>
+    struct matches {
+        template <typename Row>
+        using fn = std::bool_constant<std::is_same_v<source_of<Row>, State> && std::is_same_v<event_of<Row>, Event>>;
+    };
+
+    template <typename Row, typename Event>
+    boost::msm::back::HandledEnum fire(const Event& event)
+    {
+        static_assert(flat_row<Row>, "only flat rows of state_machine_def or functor rows are supported");
+
+        source_of<Row> source;
+        target_of<Row> target;
+        // MSM hands its state list to rows, none of the supported rows looks at it
+        state_id& all_states = state_;
+        if constexpr (has_guard<Row>) {
+            if (!Row::guard_call(*this, event, source, target, all_states)) {
+                return boost::msm::back::HANDLED_GUARD_REJECT;
+            }
+        }
+        if constexpr (!is_internal<Row>) {
+            source.on_exit(event, *this);
+        }
+        if constexpr (has_action<Row>) {
+            Row::action_call(*this, event, source, target, all_states);
+        }
+        if constexpr (!is_internal<Row>) {
+            state_ = id_of<target_of<Row>>;
+            target.on_entry(event, *this);
+        }
+        return boost::msm::back::HANDLED_TRUE;
+    }
+
+    template <typename Event>
+    boost::msm::back::HandledEnum defer(const Event& event)
+    {
+        static_assert(defer_capacity > 0, "states of this machine defer events, give it a DeferCapacity");
+        if (deferred_.full()) {
+            this->no_transition(event, *this, state_);
+            return boost::msm::back::HANDLED_FALSE;
+        }
+        deferred_.push(event);
+        return boost::msm::back::HANDLED_DEFERRED;
+    }
+
+    // One cell of the table
+    template <typename State, typename Event>
+    static boost::msm::back::HandledEnum handle(table_state_machine& fsm, const void* erased)
+    {
+        const Event& event = *static_cast<const Event*>(erased);
+        if constexpr (boost::mp11::mp_contains<deferred_of<State>, Event>::value) {
+            return fsm.defer(event);
+        } else {
+            using candidates = boost::mp11::mp_reverse<boost::mp11::mp_filter_q<matches<State, Event>, rows>>;
+            if constexpr (boost::mp11::mp_empty<candidates>::value) {
+                fsm.no_transition(event, fsm, fsm.state_);
+                return boost::msm::back::HANDLED_FALSE;
+            } else {
+                auto result = boost::msm::back::HANDLED_FALSE;
+                [&]<typename... Rows>(boost::mp11::mp_list<Rows...>) {
+                    (void)(((result = fsm.template fire<Rows>(event)) == boost::msm::back::HANDLED_TRUE) || ...);
+                }(candidates {});
+                return result;
+            }
+        }
+    }
+
+    template <typename Event, std::size_t... States>
+    static constexpr std::array<handler, state_count> column(std::index_sequence<States...>)
+    {
+        return { &handle<boost::mp11::mp_at_c<states, States>, Event>... };
+    }
+
+    template <std::size_t... Events>
+    static constexpr std::array<std::array<handler, state_count>, event_count> make_table(
+        std::index_sequence<Events...>)
+    {
+        return { column<boost::mp11::mp_at_c<events, Events>>(std::make_index_sequence<state_count>())... };
+    }
+
+    template <typename Event>
+    boost::msm::back::HandledEnum dispatch(const Event& event)
+    {
+        static constexpr auto table = make_table(std::make_index_sequence<event_count>());
+        auto timer                  = trace_.start();
+        state_id from               = state_;
+        auto result                 = boost::msm::back::HANDLED_FALSE;
+        if constexpr (boost::mp11::mp_contains<events, Event>::value) {
+            result = table[boost::mp11::mp_find<events, Event>::value][state_](*this, &event);
+        } else {
+            this->no_transition(event, *this, state_);
+        }
+        trace_.on_dispatch(timer, *this, event, from, state_, result, deferred_.size());
+        return result;
+    }
+
+    template <std::size_t... States>
+    static const std::type_info& state_type(std::size_t id, std::index_sequence<States...>) noexcept
+    {
+        static const std::array<const std::type_info*, state_count> types {
+            &typeid(boost::mp11::mp_at_c<states, States>)...,
+        };
+        return *types[id];
+    }
+
+    // A transition may enable events deferred before it, so passes repeat while they change the state
+    void replay()
+    {
+        if constexpr (defer_capacity > 0) {
+            bool moved = true;
+            while (moved && !deferred_.empty()) {
+                moved = false;
+                for (std::size_t pending = deferred_.size(); pending > 0; --pending) {
+                    auto result = std::visit([this](const auto& event) { return dispatch(event); }, deferred_.pop());
+                    moved       = moved || result == boost::msm::back::HANDLED_TRUE;
+                }
+            }
+        }
+    }
+
+    template <typename State, typename Event>
+    static void exit_state(table_state_machine& fsm, const Event& event)
+    {
+        State state;
+        state.on_exit(event, fsm);
+    }
+
+    template <typename Event, std::size_t... States>
+    void exit_current(const Event& event, std::index_sequence<States...>)
+    {
+        using exit = void (*)(table_state_machine&, const Event&);
+        static constexpr std::array<exit, state_count> exits {
+            &exit_state<boost::mp11::mp_at_c<states, States>, Event>...,
+        };
+        exits[state_](*this, event);
+    }
+
+public:
+    template <typename... Args>
+    explicit table_state_machine(Args&&... args)
+        : Front(std::forward<Args>(args)...)
+    {
+    }
+
+    // Enters the machine and its initial state, like MSM start()
+    void start()
+    {
+        boost::msm::front::none event;
+        state_ = id_of<initial>;
+        this->on_entry(event, *this);
+        initial state;
+        state.on_entry(event, *this);
+    }
+
+    // Leaves the current state and the machine, deferred events are dropped
+    void stop()
+    {
+        boost::msm::front::none event;
+        exit_current(event, std::make_index_sequence<state_count>());
+        this->on_exit(event, *this);
+        deferred_.clear();
+    }
+
+    // Same results as MSM: HANDLED_TRUE after a transition, HANDLED_GUARD_REJECT when
+    // every guard said no, HANDLED_DEFERRED when queued and HANDLED_FALSE otherwise,
+    // which also calls the front no_transition(), as does a full ring
+    template <typename Event>
+    boost::msm::back::HandledEnum process_event(const Event& event)
+    {
+        auto result = dispatch(event);
+        if (result == boost::msm::back::HANDLED_TRUE && !deferred_.empty()) {
+            replay();
+        }
+        return result;
+    }
+
+    state_id current_state() const noexcept
+    {
+        return state_;
+    }
+
+    template <typename State>
+    bool is_in() const noexcept
+    {
+        return state_ == id_of<State>;
+    }
+
+    // Type of the state with id, for traces and debugging
+    static const std::type_info& state_type(std::size_t id) noexcept
+    {
+        return state_type(id, std::make_index_sequence<state_count>());
+    }
+};
@@ -0,0 +1,90 @@
+// Copyright 2024 Severin Denisenko
+
+#include <folly/executors/CPUThreadPoolExecutor.h>
+
+#include <boost/format.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <random>
+
+#include "../Boost/lru_map.hpp"
+#include "concurrent_lru_map.hpp"
+
+static constexpr uint32_t capacity_ { 1 << 16 };
+static constexpr uint32_t keys_ { capacity_ * 2 };
+static constexpr uint32_t ops_per_thread_ { 1 << 18 };
+static constexpr uint32_t read_percent_ { 90 };
+
+// What we had before: the whole cache behind one mutex
+class locked_lru_map {
+public:
+    locked_lru_map()
+        : map_ { capacity_ }
+    {
+    }
+
+    bool contains(uint64_t key)
+    {
+        std::lock_guard lock { mtx_ };
+        return map_.contains(key);
+    }
+
+    bool put(uint64_t key, uint64_t&& value)
+    {
+        std::lock_guard lock { mtx_ };
+        return map_.put(key, std::move(value));
+    }
+
+private:
+    std::mutex mtx_;
+    lru_map<uint64_t, uint64_t> map_;
+};
+
+template <typename Cache>
+double run(Cache& cache, uint32_t threads)
+{
+    folly::CPUThreadPoolExecutor executor { threads };
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t thread = 0; thread < threads; ++thread) {
+        executor.add([thread, &cache]() {
+            std::mt19937 rng(thread);
+            std::uniform_int_distribution<uint64_t> key_dist(0, keys_ - 1);
+            std::uniform_int_distribution<uint32_t> op_dist(0, 99);
+
+            for (uint32_t op = 0; op < ops_per_thread_; ++op) {
+                uint64_t key = key_dist(rng);
+                if (op_dist(rng) < read_percent_) {
+                    cache.contains(key);
+                } else {
+                    cache.put(key, uint64_t { key });
+                }
+            }
+        });
+    }
+    executor.join();
+    auto stop = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double> seconds = stop - start;
+    return threads * static_cast<double>(ops_per_thread_) / seconds.count();
+}
+
+int main()
+{
+    using sharded_map = concurrent_lru_map<uint64_t, uint64_t>;
+
+    std::cout << boost::format("%1$8s %2$16s %3$16s %4$16s\n") % "threads" % "mutex" % "sharded" % "batched";
+    for (uint32_t threads = 1; threads <= 64; threads *= 2) {
+        locked_lru_map locked;
+        sharded_map eager { capacity_, 64, sharded_map::promotion::eager };
+        sharded_map batched { capacity_, 64, sharded_map::promotion::batched };
+
+        std::cout << boost::format("%1$8d %2$16.0f %3$16.0f %4$16.0f\n") % threads % run(locked, threads)
+                % run(eager, threads) % run(batched, threads);
+    }
+
+    return 0;
+}
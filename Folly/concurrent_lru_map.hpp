@@ -0,0 +1,187 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+
+#include <folly/SharedMutex.h>
+#include <folly/SpinLock.h>
+#include <folly/hash/Hash.h>
+#include <folly/lang/Align.h>
+
+#include <boost/container/static_vector.hpp>
+#include <boost/container/vector.hpp>
+
+#include "../Boost/lru_map.hpp"
+
+// Thread safe lru_map split into independent shards.
+// Every shard has its own intrusive map, list and lock, so threads working
+// with different keys do not contend with each other.
+// Stats of shards are merged by stats(). Batched promotion counts hits from
+// readers sharing a shard, so it needs lru_concurrent_stats or lru_no_stats.
+template <
+    typename Key,
+    typename Value,
+    typename Hash  = std::hash<Key>,
+    typename Equal = std::equal_to<Key>,
+    typename Stats = lru_no_stats>
+class concurrent_lru_map {
+public:
+    enum class promotion {
+        // Every hit moves the entry to the list tail under exclusive lock
+        eager,
+        // Hits are looked up under shared lock and remembered in a small buffer,
+        // which is replayed under exclusive lock on the next write or when it fills up
+        batched,
+    };
+
+    static constexpr std::size_t promotion_buffer_size = 32;
+
+    using shard_map = lru_map<Key, Value, Hash, Equal, lru_node_pool, lru_policy, lru_unit_weigher, Stats>;
+
+    struct alignas(folly::hardware_destructive_interference_size) shard {
+        explicit shard(std::size_t max_size)
+            : mutex_()
+            , map_(max_size)
+            , buffer_lock_()
+            , buffer_()
+        {
+        }
+
+        // Both locks must be held
+        void drain() noexcept
+        {
+            for (const Key& key : buffer_) {
+                map_.touch(key);
+            }
+            buffer_.clear();
+        }
+
+        folly::SharedMutex mutex_;
+        shard_map map_;
+
+        folly::SpinLock buffer_lock_;
+        boost::container::static_vector<Key, promotion_buffer_size> buffer_;
+    };
+
+    using shards = boost::container::vector<std::unique_ptr<shard>>;
+
+private:
+    Hash hash_;
+    promotion promotion_;
+    shards shards_;
+
+    shard& shard_for(const Key& key)
+    {
+        // Shard maps use the same hash for buckets, so mix it before picking a shard
+        std::size_t hash = folly::hash::twang_mix64(hash_(key));
+        return *shards_[hash % shards_.size()];
+    }
+
+    // Returns true when the shard buffer filled up and has to be drained
+    bool remember_hit(shard& s, const Key& key)
+    {
+        std::unique_lock lock(s.buffer_lock_, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            // Promotion is a hint, losing it under contention is fine
+            return false;
+        }
+        if (s.buffer_.size() < promotion_buffer_size) {
+            s.buffer_.push_back(key);
+        }
+        return s.buffer_.size() == promotion_buffer_size;
+    }
+
+    void try_drain(shard& s)
+    {
+        std::unique_lock lock(s.mutex_, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            return;
+        }
+        std::lock_guard buffer_lock(s.buffer_lock_);
+        s.drain();
+    }
+
+    template <typename Func>
+    auto read(const Key& key, Func&& func)
+    {
+        shard& s = shard_for(key);
+        if (promotion_ == promotion::eager) {
+            std::unique_lock lock(s.mutex_);
+            return func(static_cast<const Value*>(s.map_.find(key)));
+        }
+
+        bool full = false;
+        auto ret  = [&] {
+            std::shared_lock lock(s.mutex_);
+            const Value* value = s.map_.peek(key);
+            if (value != nullptr) {
+                full = remember_hit(s, key);
+            }
+            return func(value);
+        }();
+        if (full) {
+            try_drain(s);
+        }
+        return ret;
+    }
+
+public:
+    concurrent_lru_map(std::size_t max_size, std::size_t shard_count = 16, promotion mode = promotion::eager)
+        : hash_()
+        , promotion_(mode)
+        , shards_()
+    {
+        std::size_t shard_size = (max_size + shard_count - 1) / shard_count;
+        shards_.reserve(shard_count);
+        for (std::size_t i = 0; i < shard_count; ++i) {
+            shards_.push_back(std::make_unique<shard>(shard_size));
+        }
+    }
+
+    bool contains(const Key& key)
+    {
+        return read(key, [](const Value* value) { return value != nullptr; });
+    }
+
+    // Returns a copy, references would outlive the shard lock
+    std::optional<Value> get(const Key& key)
+    {
+        return read(key, [](const Value* value) -> std::optional<Value> {
+            if (value == nullptr) {
+                return std::nullopt;
+            }
+            return *value;
+        });
+    }
+
+    bool put(const Key& key, Value&& value)
+    {
+        shard& s = shard_for(key);
+        std::unique_lock lock(s.mutex_);
+        if (promotion_ == promotion::batched) {
+            std::lock_guard buffer_lock(s.buffer_lock_);
+            s.drain();
+        }
+        return s.map_.put(key, std::move(value));
+    }
+
+    std::size_t shard_count() const noexcept
+    {
+        return shards_.size();
+    }
+
+    lru_stats_snapshot stats() const
+    {
+        lru_stats_snapshot snapshot;
+        for (const auto& s : shards_) {
+            std::shared_lock lock(s->mutex_);
+            snapshot += s->map_.stats();
+        }
+        return snapshot;
+    }
+};
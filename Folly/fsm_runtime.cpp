@@ -0,0 +1,157 @@
+// Copyright 2024 Severin Denisenko
+
+#include <folly/executors/CPUThreadPoolExecutor.h>
+
+#include <boost/format.hpp>
+#include <boost/msm/front/state_machine_def.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <variant>
+#include <vector>
+
+#include "../Boost/table_state_machine.hpp"
+#include "fsm_runtime.hpp"
+
+namespace msm = boost::msm;
+namespace mpl = boost::mpl;
+
+struct turn_on {
+    bool hot;
+};
+struct turn_off { };
+struct burn_out { };
+
+// The lamp of Boost/state_mashine.cpp, counting what happened instead of printing
+struct lamp_ : public msm::front::state_machine_def<lamp_> {
+    uint32_t switches = 0;
+    uint32_t missed   = 0;
+
+    struct On : public msm::front::state<> {
+        using deferred_events = mpl::vector<turn_on>;
+    };
+
+    struct Off : public msm::front::state<> {
+        using deferred_events = mpl::vector<turn_off, burn_out>;
+    };
+
+    struct Burned : public msm::front::state<> { };
+
+    using initial_state = mpl::vector<Off>;
+
+    void turned_on(turn_on const&)
+    {
+        ++switches;
+    }
+
+    void turned_off(turn_off const&)
+    {
+        ++switches;
+    }
+
+    void burned(burn_out const&)
+    {
+    }
+
+    bool can_turn_on(turn_on const& ev)
+    {
+        return ev.hot;
+    }
+
+    bool always(auto const&)
+    {
+        return true;
+    }
+
+    using l = lamp_;
+
+    // clang-format off
+    struct transition_table : mpl::vector<
+        row<Off,  turn_on,   On,      &l::turned_on,   &l::can_turn_on>,
+        row<On,   turn_off,  Off,     &l::turned_off,  &l::always>,
+        row<On,   burn_out,  Burned,  &l::burned,      &l::always>>
+    { };
+    // clang-format on
+
+    template <class FSM, class Event>
+    void no_transition(Event const&, FSM&, int)
+    {
+        ++missed;
+    }
+};
+
+using lamp      = table_state_machine<lamp_, 4>;
+using runtime_t = fsm_runtime<lamp>;
+using message_t = runtime_t::message;
+
+static constexpr uint32_t lamps_ { 1 << 18 };
+static constexpr uint32_t batch_ { 1 << 20 };
+static constexpr uint32_t batches_ { 16 };
+
+// Random lamps switched at random, a few cold starts and burn outs among them
+static std::vector<message_t> random_batch(std::mt19937& rng)
+{
+    std::uniform_int_distribution<uint32_t> pick(0, lamps_ - 1);
+    std::uniform_int_distribution<uint32_t> kind(0, 99);
+
+    std::vector<message_t> batch(batch_);
+    for (message_t& m : batch) {
+        m.id          = pick(rng);
+        uint32_t roll = kind(rng);
+        if (roll < 48) {
+            m.event = turn_on { .hot = roll != 0 };
+        } else if (roll < 98) {
+            m.event = turn_off {};
+        } else {
+            m.event = burn_out {};
+        }
+    }
+    return batch;
+}
+
+int main()
+{
+    std::mt19937 rng(42);
+    std::vector<std::vector<message_t>> batches;
+    for (uint32_t i = 0; i < batches_; ++i) {
+        batches.push_back(random_batch(rng));
+    }
+
+    // Same events one after another on a single thread
+    std::vector<lamp> expected(lamps_);
+    for (lamp& l : expected) {
+        l.start();
+    }
+    for (const auto& batch : batches) {
+        for (const message_t& m : batch) {
+            std::visit([&expected, &m](const auto& event) { expected[m.id].process_event(event); }, m.event);
+        }
+    }
+
+    std::cout << boost::format("%1$8s %2$16s %3$10s\n") % "threads" % "events/s" % "same";
+    for (uint32_t threads = 1; threads <= 16; threads *= 2) {
+        folly::CPUThreadPoolExecutor executor { threads };
+        runtime_t runtime { lamps_, executor, threads };
+
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& batch : batches) {
+            runtime.process(batch);
+        }
+        auto stop = std::chrono::steady_clock::now();
+
+        // Every lamp got its events in batch order, so it ends where the sequential run did
+        bool same = true;
+        for (uint32_t id = 0; id < lamps_; ++id) {
+            same = same && runtime[id].current_state() == expected[id].current_state()
+                && runtime[id].switches == expected[id].switches && runtime[id].missed == expected[id].missed;
+        }
+
+        std::chrono::duration<double> seconds = stop - start;
+        std::cout << boost::format("%1$8d %2$16.0f %3$10s\n") % threads
+                % (static_cast<double>(batches_) * batch_ / seconds.count()) % (same ? "yes" : "no");
+    }
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <latch>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <variant>
+#include <vector>
+
+#include <folly/Executor.h>
+
+#include <boost/mp11/algorithm.hpp>
+
+// Many instances of one state machine driven by batches of events on an executor.
+//
+// Machines live in one array and are named by their index. process() splits a
+// batch into partitions of neighbouring ids and runs one task per partition, so
+// every machine is touched by a single thread and no locks are taken. Threads
+// write to separate stretches of the array, which keeps cache lines apart too.
+//
+// Messages of a partition are applied in batch order, so every machine sees its
+// events in the order they were given. process() returns once the whole batch
+// is applied, the next batch starts after it.
+//
+// Machine is table_state_machine or anything with start() and process_event()
+// for every alternative of Event, by default a variant of the machine events.
+template <typename Machine, typename Event = boost::mp11::mp_rename<typename Machine::events, std::variant>>
+class fsm_runtime {
+public:
+    using id_type = uint32_t;
+
+    struct message {
+        id_type id;
+        Event event;
+    };
+
+    // Starts every machine, batches are split into at most partitions tasks
+    fsm_runtime(std::size_t instances, folly::Executor& executor, std::size_t partitions)
+        : executor_(executor)
+        , machines_(instances)
+        , offsets_(std::clamp<std::size_t>(partitions, 1, std::max<std::size_t>(instances, 1)) + 1)
+        , cursors_(offsets_.size() - 1)
+        , errors_(offsets_.size() - 1)
+        , scale_(((offsets_.size() - 1) << 32) / std::max<std::size_t>(instances, 1))
+    {
+        for (Machine& machine : machines_) {
+            machine.start();
+        }
+    }
+
+    fsm_runtime(const fsm_runtime&)            = delete;
+    fsm_runtime& operator=(const fsm_runtime&) = delete;
+
+    // Applies every message and waits for it. An exception from a machine stops
+    // the rest of its partition and is rethrown here once the others are done,
+    // so is one from executor_.add() after the partitions it did add. One batch
+    // at a time, from one thread that is not a task of the executor: waiting
+    // there may hold the thread its own partitions need
+    void process(std::span<const message> batch)
+    {
+        partition(batch);
+
+        std::size_t busy = 0;
+        for (std::size_t p = 0; p < cursors_.size(); ++p) {
+            busy += offsets_[p] != offsets_[p + 1];
+        }
+        std::latch done { static_cast<std::ptrdiff_t>(busy) };
+        std::size_t added = 0;
+        try {
+            for (std::size_t p = 0; p < cursors_.size(); ++p) {
+                if (offsets_[p] != offsets_[p + 1]) {
+                    executor_.add([this, p, batch, &done]() {
+                        run(p, batch);
+                        done.count_down();
+                    });
+                    ++added;
+                }
+            }
+        } catch (...) {
+            // Added tasks still use the batch and the latch
+            done.count_down(static_cast<std::ptrdiff_t>(busy - added));
+            done.wait();
+            std::fill(errors_.begin(), errors_.end(), nullptr);
+            throw;
+        }
+        done.wait();
+
+        auto failed
+            = std::find_if(errors_.begin(), errors_.end(), [](const std::exception_ptr& e) { return e != nullptr; });
+        if (failed != errors_.end()) {
+            std::exception_ptr error = *failed;
+            std::fill(errors_.begin(), errors_.end(), nullptr);
+            std::rethrow_exception(error);
+        }
+    }
+
+    Machine& operator[](id_type id) noexcept
+    {
+        return machines_[id];
+    }
+
+    const Machine& operator[](id_type id) const noexcept
+    {
+        return machines_[id];
+    }
+
+    std::size_t size() const noexcept
+    {
+        return machines_.size();
+    }
+
+    std::size_t partition_count() const noexcept
+    {
+        return cursors_.size();
+    }
+
+private:
+    folly::Executor& executor_;
+    std::vector<Machine> machines_;
+    // Messages of partition p are batch[order_[offsets_[p]]] up to batch[order_[offsets_[p + 1] - 1]]
+    std::vector<std::size_t> offsets_;
+    std::vector<std::size_t> cursors_;
+    std::vector<uint32_t> order_;
+    std::vector<std::exception_ptr> errors_;
+    // Partitions hold ids in ascending ranges of about the same size
+    uint64_t scale_;
+
+    // Multiplication instead of division, it runs twice for every message
+    std::size_t partition_of(id_type id) const noexcept
+    {
+        return (id * scale_) >> 32;
+    }
+
+    // Stable counting sort of message indices by partition, reuses the buffers of the previous batch
+    void partition(std::span<const message> batch)
+    {
+        if (batch.size() > std::numeric_limits<uint32_t>::max()) {
+            throw std::length_error("fsm_runtime::process: batch too large");
+        }
+        std::fill(offsets_.begin(), offsets_.end(), 0);
+        for (const message& m : batch) {
+            if (m.id >= machines_.size()) {
+                throw std::out_of_range("fsm_runtime::process: no such instance");
+            }
+            ++offsets_[partition_of(m.id) + 1];
+        }
+        std::partial_sum(offsets_.begin(), offsets_.end(), offsets_.begin());
+        std::copy(offsets_.begin(), offsets_.end() - 1, cursors_.begin());
+
+        order_.resize(batch.size());
+        for (uint32_t i = 0; i < batch.size(); ++i) {
+            order_[cursors_[partition_of(batch[i].id)]++] = i;
+        }
+    }
+
+    void run(std::size_t p, std::span<const message> batch) noexcept
+    {
+        try {
+            for (std::size_t i = offsets_[p]; i < offsets_[p + 1]; ++i) {
+                const message& m = batch[order_[i]];
+                std::visit([this, &m](const auto& event) { machines_[m.id].process_event(event); }, m.event);
+            }
+        } catch (...) {
+            errors_[p] = std::current_exception();
+        }
+    }
+};
@@ -3,35 +3,57 @@
 #include <folly/Function.h>
 #include <folly/Try.h>
 #include <folly/Unit.h>
-#include <folly/executors/ThreadedExecutor.h>
 #include <folly/futures/Future.h>
 #include <folly/futures/Promise.h>
 
 #include <boost/format.hpp>
 
 #include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
 
-class Worker {
-public:
-    template <typename Res>
-    folly::Future<Res> doWork(folly::Function<Res(folly::Unit)> work)
-    {
-        folly::Promise<Res> promise;
-        folly::Future<Res> future = promise.getFuture();
-        executor_.add([promise = std::move(promise), work = std::move(work)]() mutable {
-            std::move(promise).setValue(work(folly::Unit {}));
-        });
-        return std::move(future);
-    }
+#include "worker.hpp"
+
+// Cheap stages in a row. parse and format share a worker, so format runs right
+// after parse in the same task, print needs a hop to the other worker
+static void pipeline()
+{
+    std::optional<Worker> front { std::in_place };
+    std::optional<Worker> back { std::in_place };
+    worker_stage parse { *front, "parse" };
+    worker_stage format { *front, "format" };
+    worker_stage print { *back, "print" };
 
-    folly::ThreadedExecutor& getExecutor()
-    {
-        return executor_;
+    std::size_t printed = 0;
+    std::vector<folly::Future<folly::Unit>> lines;
+    for (int line = 0; line < 1000; ++line) {
+        lines.push_back(front->doWork<std::string>([line]() { return std::to_string(line); })
+                            .via(&parse)
+                            .thenValue([](std::string text) { return std::stoi(text); })
+                            .via(&format)
+                            .thenValue([](int value) { return (boost::format("%1$04d") % value).str(); })
+                            .via(&print)
+                            .thenValue([&printed](std::string text) -> folly::Unit {
+                                printed += text.size();
+                                return {};
+                            }));
     }
+    folly::collectAll(lines).wait();
 
-private:
-    folly::ThreadedExecutor executor_;
-};
+    // Joined workers run nothing more, the counters are final
+    front.reset();
+    back.reset();
+
+    std::cout << boost::format("Pipeline printed %1% characters\n") % printed;
+    std::cout << boost::format("%1$8s %2$8s %3$8s %4$14s %5$12s\n") % "stage" % "inline" % "queued" % "mean_wait_ns"
+            % "mean_run_ns";
+    for (const worker_stage* stage : { &parse, &format, &print }) {
+        worker_stage_stats stats = stage->stats();
+        std::cout << boost::format("%1$8s %2$8d %3$8d %4$14.0f %5$12.0f\n") % stage->name() % stats.inline_runs
+                % stats.queued_runs % stats.mean_wait_ns() % stats.mean_run_ns();
+    }
+}
 
 int main()
 {
@@ -63,5 +85,7 @@ int main()
     // folly::collectAll combines future into one
     folly::collectAll(first, second).wait();
 
+    pipeline();
+
     return 0;
 }
@@ -4,7 +4,6 @@
 #include <folly/Function.h>
 #include <folly/Try.h>
 #include <folly/Unit.h>
-#include <folly/executors/ThreadedExecutor.h>
 #include <folly/futures/Future.h>
 #include <folly/futures/Promise.h>
 
@@ -13,22 +12,7 @@
 #include <iostream>
 #include <stdexcept>
 
-class Worker {
-public:
-    template <typename Res>
-    folly::Future<Res> doWork(folly::Function<Res(void)> work)
-    {
-        folly::Promise<Res> promise;
-        folly::Future<Res> future = promise.getFuture();
-        executor_.add(
-            [promise = std::move(promise), work = std::move(work)]() mutable { std::move(promise).setValue(work()); });
-        return std::move(future);
-    }
-
-private:
-    // ThreadedExecutor spawns new tread for each task
-    folly::ThreadedExecutor executor_;
-};
+#include "worker.hpp"
 
 int main()
 {
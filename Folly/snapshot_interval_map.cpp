@@ -0,0 +1,169 @@
+// Copyright 2024 Severin Denisenko
+
+#include <folly/SharedMutex.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+
+#include <boost/container/flat_set.hpp>
+#include <boost/format.hpp>
+#include <boost/icl/interval_map.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+
+#include "snapshot_interval_map.hpp"
+
+using number_t        = uint32_t;
+using set_t           = boost::container::flat_set<number_t>;
+using interval_map_t  = boost::icl::interval_map<number_t, set_t>;
+using interval_t      = interval_map_t::interval_type;
+using snapshot_map_t  = snapshot_interval_map<number_t, set_t>;
+using snapshot_view_t = snapshot_map_t::version;
+
+static constexpr number_t domain_ { 1 << 20 };
+static constexpr number_t mean_length_ { 1024 };
+static constexpr uint32_t intervals_ { 1 << 14 };
+static constexpr uint32_t reads_per_thread_ { 1 << 18 };
+static constexpr uint32_t batch_ { 64 };
+
+static std::pair<interval_t, set_t> random_segment(std::mt19937& rng)
+{
+    std::uniform_int_distribution<number_t> start(0, domain_ - 1);
+    std::uniform_int_distribution<number_t> length(1, 2 * mean_length_);
+    std::uniform_int_distribution<number_t> id(0, intervals_ - 1);
+
+    number_t lower = start(rng);
+    return std::make_pair(interval_t::right_open(lower, lower + length(rng)), set_t { id(rng) });
+}
+
+// What we had before: the whole map behind one lock, the writer holds it for a batch
+class locked_interval_map {
+public:
+    std::size_t find(number_t point)
+    {
+        std::shared_lock lock { mtx_ };
+        auto it = map_.find(point);
+        return it == map_.end() ? 0 : it->second.size();
+    }
+
+    template <typename Batch>
+    void update(Batch&& batch)
+    {
+        std::unique_lock lock { mtx_ };
+        batch(map_);
+    }
+
+private:
+    folly::SharedMutex mtx_;
+    interval_map_t map_;
+};
+
+class published_interval_map {
+public:
+    std::size_t find(number_t point)
+    {
+        return map_.read([point](const snapshot_view_t& version) {
+            const set_t* set = version.find(point);
+            return set == nullptr ? 0 : set->size();
+        });
+    }
+
+    template <typename Batch>
+    void update(Batch&& batch)
+    {
+        batch(map_);
+        map_.publish();
+    }
+
+private:
+    snapshot_map_t map_;
+};
+
+// Readers look up random points while one writer keeps adding and removing
+// intervals in batches, returns lookups per second
+template <typename Map>
+double run(Map& map, uint32_t readers)
+{
+    folly::CPUThreadPoolExecutor executor { readers + 1 };
+    std::atomic<bool> done { false };
+
+    executor.add([&map, &done]() {
+        std::mt19937 rng(0);
+        for (uint32_t i = 0; i < intervals_; i += batch_) {
+            map.update([&rng](auto& m) {
+                for (uint32_t j = 0; j < batch_; ++j) {
+                    m += random_segment(rng);
+                }
+            });
+        }
+        while (!done.load(std::memory_order_relaxed)) {
+            map.update([&rng](auto& m) {
+                for (uint32_t j = 0; j < batch_; ++j) {
+                    m -= random_segment(rng);
+                    m += random_segment(rng);
+                }
+            });
+        }
+    });
+
+    std::atomic<uint32_t> running { readers };
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t reader = 0; reader < readers; ++reader) {
+        executor.add([reader, &map, &done, &running]() {
+            std::mt19937 rng(reader + 1);
+            std::uniform_int_distribution<number_t> point(0, domain_ - 1);
+
+            for (uint32_t op = 0; op < reads_per_thread_; ++op) {
+                map.find(point(rng));
+            }
+            if (running.fetch_sub(1) == 1) {
+                done.store(true, std::memory_order_relaxed);
+            }
+        });
+    }
+    executor.join();
+    auto stop = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double> seconds = stop - start;
+    return readers * static_cast<double>(reads_per_thread_) / seconds.count();
+}
+
+int main()
+{
+    std::cout << boost::format("%1$8s %2$16s %3$16s\n") % "readers" % "locked" % "snapshot";
+    for (uint32_t readers = 1; readers <= 32; readers *= 2) {
+        locked_interval_map locked;
+        published_interval_map published;
+
+        std::cout << boost::format("%1$8d %2$16.0f %3$16.0f\n") % readers % run(locked, readers)
+                % run(published, readers);
+    }
+
+    // Readers see whole segments, even where the writer keeps them in different chunks
+    snapshot_map_t map { 2 };
+    map += std::make_pair(interval_t::open(0, 10), set_t { 0 });
+    map += std::make_pair(interval_t::open(5, 10), set_t { 1 });
+    map.publish();
+    map += std::make_pair(interval_t::open(0, 5), set_t { 2 });
+    map += std::make_pair(interval_t::open(3, 7), set_t { 3 });
+
+    auto print = [](const snapshot_view_t& version) {
+        std::cout << boost::format("\nversion %1%, %2% chunks\n") % version.number() % version.chunk_count();
+        version.for_each([](const interval_t& interval, const set_t& set) {
+            std::cout << boost::format("[%1%: %2%]:") % boost::icl::first(interval) % boost::icl::last(interval);
+            for (number_t id : set) {
+                std::cout << boost::format(" %1%") % id;
+            }
+            std::cout << std::endl;
+        });
+    };
+    map.read(print);
+    map.publish();
+    map.read(print);
+
+    return 0;
+}
@@ -0,0 +1,295 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <folly/synchronization/Rcu.h>
+
+#include <boost/icl/interval_map.hpp>
+#include <boost/smart_ptr/intrusive_ptr.hpp>
+#include <boost/smart_ptr/intrusive_ref_counter.hpp>
+
+// boost::icl::interval_map read by many threads while one writer updates it.
+//
+// The domain is cut into chunks, each an interval_map of its own range holding
+// at most max_segments segments. A version is an array of pointers to chunks and
+// never changes once published. Readers load the current version inside an RCU
+// read section, without locks or reference counting.
+//
+// The writer applies += and -= to a private array of the same chunks, cloning a
+// chunk the first time it touches it after a publish. publish() swaps in a new
+// version built from that array and retires the old one, which is freed once no
+// reader can see it. Untouched chunks are shared by both versions, so a publish
+// costs the chunks changed since the last one plus an array of pointers.
+//
+// Segments are split at chunk bounds. Reads join them back, so they see the same
+// segments as a single interval_map. Chunks are split when they grow too large
+// and never merged back.
+template <typename Domain, typename Set>
+class snapshot_interval_map {
+public:
+    using map_type      = boost::icl::interval_map<Domain, Set>;
+    using interval_type = typename map_type::interval_type;
+    using segment_type  = std::pair<interval_type, Set>;
+
+private:
+    struct chunk : boost::intrusive_ref_counter<chunk> {
+        map_type map_;
+    };
+
+    using chunk_ptr = boost::intrusive_ptr<chunk>;
+
+public:
+    // Immutable state seen by readers
+    class version {
+    public:
+        version(uint64_t number, const std::vector<Domain>& firsts, const std::vector<chunk_ptr>& chunks)
+            : number_(number)
+            , firsts_(firsts)
+            , chunks_(chunks)
+        {
+        }
+
+        uint64_t number() const noexcept
+        {
+            return number_;
+        }
+
+        std::size_t chunk_count() const noexcept
+        {
+            return chunks_.size();
+        }
+
+        // Set of the segment covering point, nullptr in a gap
+        const Set* find(Domain point) const
+        {
+            const map_type& map = chunks_[chunk_of(firsts_, point)]->map_;
+            auto it             = map.find(point);
+            return it == map.end() ? nullptr : &it->second;
+        }
+
+        // Calls func(interval, set) for every segment overlapping in, in ascending order
+        template <typename Func>
+        void for_each(const interval_type& in, Func&& func) const
+        {
+            if (boost::icl::is_empty(in)) {
+                return;
+            }
+            interval_type wide = widen(in);
+            joiner<Func> join { func };
+            std::size_t last = chunk_of(firsts_, boost::icl::last(wide));
+            for (std::size_t i = chunk_of(firsts_, boost::icl::first(wide)); i <= last; ++i) {
+                auto [first, end] = chunks_[i]->map_.equal_range(wide);
+                for (auto it = first; it != end; ++it) {
+                    join(it->first, it->second);
+                }
+            }
+            join.flush();
+        }
+
+        // Calls func(interval, set) for every segment in ascending order
+        template <typename Func>
+        void for_each(Func&& func) const
+        {
+            for_each(interval_type::closed(std::numeric_limits<Domain>::min(), std::numeric_limits<Domain>::max()),
+                std::forward<Func>(func));
+        }
+
+    private:
+        uint64_t number_;
+        std::vector<Domain> firsts_;
+        std::vector<chunk_ptr> chunks_;
+
+        // Whether the last segment of chunk i continues into the first one of chunk i + 1
+        bool continues(std::size_t i) const
+        {
+            const map_type& before = chunks_[i]->map_;
+            const map_type& after  = chunks_[i + 1]->map_;
+            if (before.empty() || after.empty()) {
+                return false;
+            }
+            auto tail    = std::prev(before.end());
+            auto head    = after.begin();
+            Domain bound = firsts_[i + 1];
+            return boost::icl::last(tail->first) == bound - 1 && boost::icl::first(head->first) == bound
+                && tail->second == head->second;
+        }
+
+        // Grows in to whole segments where they cross chunk bounds, interval_map would report them unsplit
+        interval_type widen(const interval_type& in) const
+        {
+            Domain first = boost::icl::first(in);
+            for (std::size_t i = chunk_of(firsts_, first); i > 0 && continues(i - 1); --i) {
+                auto head = chunks_[i]->map_.begin();
+                if (!boost::icl::contains(head->first, first)) {
+                    break;
+                }
+                first = boost::icl::first(std::prev(chunks_[i - 1]->map_.end())->first);
+            }
+            Domain last = boost::icl::last(in);
+            for (std::size_t i = chunk_of(firsts_, last); i + 1 < chunks_.size() && continues(i); ++i) {
+                auto tail = std::prev(chunks_[i]->map_.end());
+                if (!boost::icl::contains(tail->first, last)) {
+                    break;
+                }
+                last = boost::icl::last(chunks_[i + 1]->map_.begin()->first);
+            }
+            return interval_type::closed(first, last);
+        }
+    };
+
+private:
+    // Holds back a segment ending at a chunk bound until the next one shows whether they continue each other
+    template <typename Func>
+    struct joiner {
+        Func& func_;
+        Domain first_ {};
+        Domain last_ {};
+        const Set* set_ = nullptr;
+
+        void operator()(const interval_type& in, const Set& set)
+        {
+            Domain first = boost::icl::first(in);
+            if (set_ != nullptr && last_ != std::numeric_limits<Domain>::max() && last_ + 1 == first && *set_ == set) {
+                last_ = boost::icl::last(in);
+                return;
+            }
+            flush();
+            first_ = first;
+            last_  = boost::icl::last(in);
+            set_   = &set;
+        }
+
+        void flush()
+        {
+            if (set_ != nullptr) {
+                func_(interval_type::closed(first_, last_), *set_);
+                set_ = nullptr;
+            }
+        }
+    };
+
+    std::atomic<const version*> current_;
+    std::size_t max_segments_;
+    uint64_t number_;
+    // Chunk i covers firsts_[i] up to firsts_[i + 1] - 1, the last one up to the end of the domain
+    std::vector<Domain> firsts_;
+    std::vector<chunk_ptr> chunks_;
+
+    static std::size_t chunk_of(const std::vector<Domain>& firsts, Domain point) noexcept
+    {
+        return std::upper_bound(firsts.begin(), firsts.end(), point) - firsts.begin() - 1;
+    }
+
+    interval_type range_of(std::size_t i) const
+    {
+        Domain last = i + 1 == firsts_.size() ? std::numeric_limits<Domain>::max() : firsts_[i + 1] - 1;
+        return interval_type::closed(firsts_[i], last);
+    }
+
+    // Chunks still referenced by a published version are cloned before the first change
+    map_type& writable(std::size_t i)
+    {
+        if (chunks_[i]->use_count() > 1) {
+            chunk_ptr copy(new chunk);
+            copy->map_ = chunks_[i]->map_;
+            chunks_[i] = std::move(copy);
+        }
+        return chunks_[i]->map_;
+    }
+
+    // Halves the chunk at its middle segment, chunk i must be writable
+    void split(std::size_t i)
+    {
+        map_type& map       = chunks_[i]->map_;
+        auto middle         = std::next(map.begin(), map.iterative_size() / 2);
+        Domain cut          = boost::icl::first(middle->first);
+        interval_type range = range_of(i);
+
+        chunk_ptr upper(new chunk);
+        upper->map_ = map & interval_type::closed(cut, boost::icl::last(range));
+        map         = map & interval_type::closed(boost::icl::first(range), cut - 1);
+        firsts_.insert(firsts_.begin() + i + 1, cut);
+        chunks_.insert(chunks_.begin() + i + 1, std::move(upper));
+    }
+
+    template <typename Apply>
+    void update(const interval_type& in, Apply&& apply)
+    {
+        if (boost::icl::is_empty(in)) {
+            return;
+        }
+        // Backwards, so a split only moves chunks already done
+        std::size_t first = chunk_of(firsts_, boost::icl::first(in));
+        for (std::size_t i = chunk_of(firsts_, boost::icl::last(in)) + 1; i-- > first;) {
+            map_type& map = writable(i);
+            apply(map, in & range_of(i));
+            if (map.iterative_size() > max_segments_) {
+                split(i);
+            }
+        }
+    }
+
+public:
+    // Chunks of a few hundred segments keep both the clone on write and the pointer array small
+    explicit snapshot_interval_map(std::size_t max_segments = 256)
+        : current_(nullptr)
+        , max_segments_(std::max<std::size_t>(max_segments, 2))
+        , number_(0)
+        , firsts_ { std::numeric_limits<Domain>::min() }
+        , chunks_ { chunk_ptr(new chunk) }
+    {
+        current_.store(new version(number_, firsts_, chunks_), std::memory_order_release);
+    }
+
+    snapshot_interval_map(const snapshot_interval_map&)            = delete;
+    snapshot_interval_map& operator=(const snapshot_interval_map&) = delete;
+
+    // No reader may be left, versions retired earlier own their chunks and free them on their own
+    ~snapshot_interval_map()
+    {
+        delete current_.load(std::memory_order_relaxed);
+    }
+
+    // Calls func(const version&) on the latest published version, from any thread. The
+    // version and everything in it may be freed as soon as func returns
+    template <typename Func>
+    auto read(Func&& func) const
+    {
+        std::scoped_lock<folly::rcu_domain> guard(folly::rcu_default_domain());
+        return func(*current_.load(std::memory_order_acquire));
+    }
+
+    // Writer side, changes stay invisible to readers until publish(). Only one thread may write at a time
+    snapshot_interval_map& operator+=(const segment_type& segment)
+    {
+        update(segment.first, [&segment](map_type& map, const interval_type& in) {
+            map += std::make_pair(in, segment.second);
+        });
+        return *this;
+    }
+
+    snapshot_interval_map& operator-=(const segment_type& segment)
+    {
+        update(segment.first, [&segment](map_type& map, const interval_type& in) {
+            map -= std::make_pair(in, segment.second);
+        });
+        return *this;
+    }
+
+    // Makes all changes so far visible to readers started after it, returns the new version number
+    uint64_t publish()
+    {
+        const version* old = current_.exchange(new version(++number_, firsts_, chunks_), std::memory_order_acq_rel);
+        folly::rcu_retire(old);
+        return number_;
+    }
+};
@@ -1,15 +1,42 @@
 // Copyright 2024 Severin Denisenko
 
 #include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/synchronization/Baton.h>
 
 #include <boost/format.hpp>
 
+#include <atomic>
 #include <cstdint>
 #include <iostream>
 #include <mutex>
 #include <random>
 #include <thread>
 
+#include "work_stealing_executor.hpp"
+
+// Sums first up to last - 1, halves the range on a new task until it is small.
+// The last task to finish posts done
+void parallel_sum(folly::Executor& executor, uint64_t first, uint64_t last, std::atomic<uint64_t>& sum,
+    std::atomic<uint32_t>& pending, folly::Baton<>& done)
+{
+    while (last - first > 1024) {
+        uint64_t middle = first + (last - first) / 2;
+        pending.fetch_add(1, std::memory_order_relaxed);
+        executor.add([&executor, middle, last, &sum, &pending, &done]() {
+            parallel_sum(executor, middle, last, sum, pending, done);
+        });
+        last = middle;
+    }
+    uint64_t local = 0;
+    for (uint64_t i = first; i < last; ++i) {
+        local += i;
+    }
+    sum.fetch_add(local, std::memory_order_relaxed);
+    if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        done.post();
+    }
+}
+
 int main()
 {
     uint32_t threads = 5;
@@ -36,4 +63,14 @@ int main()
     }
 
     executor.join();
+
+    // Tasks spawning tasks stay on the thread that spawned them until an idle one steals them
+    work_stealing_executor stealing { threads };
+    std::atomic<uint64_t> sum { 0 };
+    std::atomic<uint32_t> pending { 1 };
+    folly::Baton<> done;
+    uint64_t count = 1 << 24;
+    stealing.add([&stealing, count, &sum, &pending, &done]() { parallel_sum(stealing, 0, count, sum, pending, done); });
+    done.wait();
+    std::cout << boost::format("Sum of 0 to %1% is %2%\n") % (count - 1) % sum.load();
 }
@@ -0,0 +1,320 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <folly/Executor.h>
+#include <folly/synchronization/EventCount.h>
+
+// Chase-Lev deque of pointers, in the C11 form of Le, Pop, Cohen and Zappa
+// Nardelli. The owner pushes and takes at the bottom, so it runs the newest
+// task first, other threads steal the oldest one from the top. Empty is nullptr,
+// so is a steal that lost a race.
+template <typename T>
+class chase_lev_deque {
+    static_assert(std::is_pointer_v<T>, "chase_lev_deque holds pointers");
+
+    struct buffer {
+        explicit buffer(std::size_t capacity)
+            : mask_(capacity - 1)
+            , slots_(new std::atomic<T>[capacity])
+        {
+        }
+
+        T get(int64_t i) const noexcept
+        {
+            return slots_[i & mask_].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t i, T item) noexcept
+        {
+            slots_[i & mask_].store(item, std::memory_order_relaxed);
+        }
+
+        std::size_t mask_;
+        std::unique_ptr<std::atomic<T>[]> slots_;
+    };
+
+public:
+    explicit chase_lev_deque(std::size_t capacity = 256)
+    {
+        buffers_.push_back(std::make_unique<buffer>(std::bit_ceil(std::max<std::size_t>(capacity, 2))));
+        buffer_.store(buffers_.back().get(), std::memory_order_relaxed);
+    }
+
+    chase_lev_deque(const chase_lev_deque&)            = delete;
+    chase_lev_deque& operator=(const chase_lev_deque&) = delete;
+
+    // Owner only
+    void push(T item)
+    {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top    = top_.load(std::memory_order_acquire);
+        buffer* slots  = buffer_.load(std::memory_order_relaxed);
+        if (bottom - top > static_cast<int64_t>(slots->mask_)) {
+            slots = grow(slots, top, bottom);
+        }
+        slots->put(bottom, item);
+        bottom_.store(bottom + 1, std::memory_order_release);
+    }
+
+    // Owner only
+    T take() noexcept
+    {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        buffer* slots  = buffer_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T item = slots->get(bottom);
+        if (top == bottom) {
+            // Last one, a thief may be after it too
+            if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // Any thread
+    T steal() noexcept
+    {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return nullptr;
+        }
+        T item = buffer_.load(std::memory_order_acquire)->get(top);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+private:
+    // Owner and thieves touch different ends, keep them on different cache lines
+    alignas(64) std::atomic<int64_t> top_ { 0 };
+    alignas(64) std::atomic<int64_t> bottom_ { 0 };
+    std::atomic<buffer*> buffer_;
+    // Thieves may still read from a buffer that was outgrown, all of them go with the deque
+    std::vector<std::unique_ptr<buffer>> buffers_;
+
+    buffer* grow(buffer* slots, int64_t top, int64_t bottom)
+    {
+        auto bigger = std::make_unique<buffer>((slots->mask_ + 1) * 2);
+        for (int64_t i = top; i < bottom; ++i) {
+            bigger->put(i, slots->get(i));
+        }
+        buffers_.push_back(std::move(bigger));
+        buffer_.store(buffers_.back().get(), std::memory_order_release);
+        return buffers_.back().get();
+    }
+};
+
+// folly::Executor with a Chase-Lev deque per worker thread.
+//
+// Tasks added from a worker go to its own deque and it runs the newest first,
+// tasks added from other threads go to a shared inbox. An idle worker takes from
+// its deque, then the inbox, then steals from the other workers, starting at a
+// random one. When all of that comes up empty it parks on a folly::EventCount.
+// Adding a task wakes a parked worker only when none is searching already, so a
+// burst of tasks does not wake every thread one by one.
+class work_stealing_executor : public folly::Executor {
+public:
+    explicit work_stealing_executor(std::size_t threads = std::thread::hardware_concurrency())
+    {
+        threads = std::max<std::size_t>(threads, 1);
+        for (std::size_t i = 0; i < threads; ++i) {
+            workers_.push_back(std::make_unique<worker>(this, i + 1));
+        }
+        for (auto& w : workers_) {
+            threads_.emplace_back([this, self = w.get()]() { run(*self); });
+        }
+    }
+
+    work_stealing_executor(const work_stealing_executor&)            = delete;
+    work_stealing_executor& operator=(const work_stealing_executor&) = delete;
+
+    ~work_stealing_executor() override
+    {
+        join();
+    }
+
+    void add(folly::Func func) override
+    {
+        auto* task   = new folly::Func(std::move(func));
+        worker* self = current_;
+        if (self != nullptr && self->owner_ == this) {
+            self->deque_.push(task);
+        } else {
+            std::lock_guard lock { inbox_mtx_ };
+            inbox_.push_back(task);
+            inbox_size_.store(inbox_.size(), std::memory_order_relaxed);
+        }
+        wake();
+    }
+
+    // Runs every task added so far and the ones they add, then stops the threads.
+    // Nothing may be added from outside afterwards
+    void join()
+    {
+        stopping_.store(true, std::memory_order_release);
+        parked_.notifyAll();
+        for (std::thread& thread : threads_) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    std::size_t numThreads() const noexcept
+    {
+        return workers_.size();
+    }
+
+private:
+    struct worker {
+        worker(work_stealing_executor* owner, uint64_t seed)
+            : owner_(owner)
+            , rng_(seed * 0x9E3779B97F4A7C15ull)
+        {
+        }
+
+        // xorshift64, for picking victims
+        std::size_t next_victim() noexcept
+        {
+            rng_ ^= rng_ << 13;
+            rng_ ^= rng_ >> 7;
+            rng_ ^= rng_ << 17;
+            return rng_;
+        }
+
+        work_stealing_executor* owner_;
+        uint64_t rng_;
+        chase_lev_deque<folly::Func*> deque_;
+    };
+
+    static inline thread_local worker* current_ = nullptr;
+
+    std::vector<std::unique_ptr<worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    std::mutex inbox_mtx_;
+    std::deque<folly::Func*> inbox_;
+    std::atomic<std::size_t> inbox_size_ { 0 };
+
+    folly::EventCount parked_;
+    alignas(64) std::atomic<uint32_t> sleeping_ { 0 };
+    std::atomic<uint32_t> searching_ { 0 };
+    std::atomic<bool> stopping_ { false };
+
+    // Pairs with the counters going up in find() and park(), either this sees a
+    // searching or sleeping worker or that worker sees the task on its next look.
+    // A worker already searching will find the task, so no other one is woken
+    void wake() noexcept
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_relaxed) > 0 && searching_.load(std::memory_order_relaxed) == 0) {
+            parked_.notify();
+        }
+    }
+
+    folly::Func* find(worker& self)
+    {
+        if (folly::Func* task = self.deque_.take()) {
+            return task;
+        }
+        searching_.fetch_add(1, std::memory_order_seq_cst);
+        folly::Func* task = search(self);
+        searching_.fetch_sub(1, std::memory_order_seq_cst);
+        // A task added while this one searched may have woken nobody
+        if (task == nullptr) {
+            task = search(self);
+        }
+        // Work came from elsewhere, there may be more for a parked worker
+        if (task != nullptr) {
+            wake();
+        }
+        return task;
+    }
+
+    folly::Func* search(worker& self)
+    {
+        folly::Func* task = nullptr;
+        if (inbox_size_.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard lock { inbox_mtx_ };
+            if (!inbox_.empty()) {
+                task = inbox_.front();
+                inbox_.pop_front();
+                inbox_size_.store(inbox_.size(), std::memory_order_relaxed);
+            }
+        }
+        std::size_t first = self.next_victim() % workers_.size();
+        for (std::size_t i = 0; task == nullptr && i < workers_.size(); ++i) {
+            worker& victim = *workers_[(first + i) % workers_.size()];
+            if (&victim != &self) {
+                task = victim.deque_.steal();
+            }
+        }
+        return task;
+    }
+
+    // An exception escaping a task is dropped, like CPUThreadPoolExecutor does after logging it
+    static void execute(folly::Func* task) noexcept
+    {
+        std::unique_ptr<folly::Func> owned(task);
+        try {
+            (*owned)();
+        } catch (...) {
+        }
+    }
+
+    // Parks unless work shows up, returns false once stopping with nothing left to do
+    bool park(worker& self)
+    {
+        sleeping_.fetch_add(1, std::memory_order_seq_cst);
+        auto key = parked_.prepareWait();
+        if (folly::Func* task = find(self)) {
+            parked_.cancelWait();
+            sleeping_.fetch_sub(1, std::memory_order_relaxed);
+            execute(task);
+            return true;
+        }
+        if (stopping_.load(std::memory_order_acquire)) {
+            parked_.cancelWait();
+            sleeping_.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+        parked_.wait(key);
+        sleeping_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void run(worker& self)
+    {
+        current_ = &self;
+        do {
+            while (folly::Func* task = find(self)) {
+                execute(task);
+            }
+        } while (park(self));
+        current_ = nullptr;
+    }
+};
@@ -0,0 +1,494 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <new>
+#include <semaphore>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <folly/Executor.h>
+#include <folly/Unit.h>
+#include <folly/concurrency/UnboundedQueue.h>
+#include <folly/futures/Future.h>
+#include <folly/futures/Promise.h>
+
+// Task in a Worker queue. Callables of up to inline_size bytes live inside the
+// task, so queueing them allocates nothing, larger ones go to the heap.
+class worker_task {
+public:
+    static constexpr std::size_t inline_size = 112;
+
+    worker_task() noexcept = default;
+
+    template <typename Func, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Func>, worker_task>>>
+    explicit worker_task(Func&& func)
+    {
+        using stored = std::decay_t<Func>;
+        if constexpr (fits<stored>) {
+            ::new (storage_) stored(std::forward<Func>(func));
+            ops_ = &inline_ops<stored>;
+        } else {
+            ::new (storage_) stored*(new stored(std::forward<Func>(func)));
+            ops_ = &heap_ops<stored>;
+        }
+    }
+
+    worker_task(worker_task&& other) noexcept
+    {
+        take(other);
+    }
+
+    worker_task& operator=(worker_task&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    ~worker_task()
+    {
+        reset();
+    }
+
+    // An empty task tells a thread of the worker to stop
+    explicit operator bool() const noexcept
+    {
+        return ops_ != nullptr;
+    }
+
+    void operator()()
+    {
+        ops_->call(storage_);
+    }
+
+private:
+    struct ops {
+        void (*call)(void*);
+        void (*move)(void* from, void* to) noexcept;
+        void (*destroy)(void*) noexcept;
+    };
+
+    template <typename T>
+    static constexpr bool fits = sizeof(T) <= inline_size && alignof(T) <= alignof(std::max_align_t)
+        && std::is_nothrow_move_constructible_v<T>;
+
+    template <typename T>
+    static constexpr ops inline_ops {
+        [](void* self) { (*static_cast<T*>(self))(); },
+        [](void* from, void* to) noexcept {
+            ::new (to) T(std::move(*static_cast<T*>(from)));
+            static_cast<T*>(from)->~T();
+        },
+        [](void* self) noexcept { static_cast<T*>(self)->~T(); },
+    };
+
+    template <typename T>
+    static constexpr ops heap_ops {
+        [](void* self) { (**static_cast<T**>(self))(); },
+        [](void* from, void* to) noexcept { ::new (to) T*(*static_cast<T**>(from)); },
+        [](void* self) noexcept { delete *static_cast<T**>(self); },
+    };
+
+    const ops* ops_ = nullptr;
+    alignas(std::max_align_t) unsigned char storage_[inline_size];
+
+    void take(worker_task& other) noexcept
+    {
+        ops_ = std::exchange(other.ops_, nullptr);
+        if (ops_ != nullptr) {
+            ops_->move(other.storage_, storage_);
+        }
+    }
+
+    void reset() noexcept
+    {
+        if (ops_ != nullptr) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+};
+
+struct worker_options {
+    // Started with the worker and kept until it is destroyed
+    std::size_t threads = 1;
+    // Thread i is pinned to cpus[i % cpus.size()] and there is a queue per NUMA node
+    // of these CPUs. Empty lets threads run anywhere and share one queue
+    std::vector<unsigned> cpus;
+    // Tasks from other threads waiting in the worker before doWork() and add() block
+    // there. Threads of any Worker never block, so tasks adding tasks cannot deadlock
+    std::size_t queue_capacity = 1024;
+};
+
+// CPUs this process may run on
+inline std::vector<unsigned> worker_cpus()
+{
+    std::vector<unsigned> cpus;
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+// NUMA node of every CPU from sysfs, node 0 for all of them without NUMA
+inline std::vector<unsigned> worker_cpu_nodes()
+{
+    std::vector<unsigned> nodes(CPU_SETSIZE, 0);
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("node", 0) != 0 || name.size() == 4 || !std::isdigit(name[4])) {
+            continue;
+        }
+        unsigned node = std::stoul(name.substr(4));
+
+        // Like 0-3,8-11
+        std::ifstream file(entry.path() / "cpulist");
+        std::string range;
+        while (std::getline(file, range, ',')) {
+            std::istringstream in(range);
+            unsigned first = 0;
+            if (!(in >> first)) {
+                continue;
+            }
+            // A single CPU has no dash, last stays first
+            unsigned last = first;
+            char dash     = 0;
+            in >> dash >> last;
+            for (unsigned cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+                nodes[cpu] = node;
+            }
+        }
+    }
+    return nodes;
+}
+
+// Runs work on a fixed set of threads started once, instead of a thread per task.
+//
+// doWork() and add() wrap the task into a worker_task and put it into an unbounded
+// folly::UMPMCQueue. With pinned threads every NUMA node of their CPUs gets its
+// own queue, served only by the threads on that node. A task goes to the queue
+// of the thread adding it: a worker thread uses its own, others the one of the
+// node they run on, or the queues in turn when their node has none. Threads not
+// of any Worker wait while queue_capacity of their tasks are queued, tasks adding
+// tasks never do.
+class Worker : public folly::Executor {
+public:
+    explicit Worker(worker_options options = {})
+        : room_(static_cast<std::ptrdiff_t>(std::clamp<std::size_t>(
+            options.queue_capacity, 1, static_cast<std::size_t>(std::counting_semaphore<>::max()))))
+    {
+        std::size_t threads = std::max<std::size_t>(options.threads, 1);
+        std::vector<std::size_t> thread_queue(threads, 0);
+        if (options.cpus.empty()) {
+            queues_.push_back(std::make_unique<queue>());
+        } else {
+            std::vector<unsigned> nodes = worker_cpu_nodes();
+            std::vector<std::size_t> node_queue(CPU_SETSIZE, npos);
+            for (std::size_t i = 0; i < threads; ++i) {
+                unsigned cpu = options.cpus[i % options.cpus.size()];
+                if (cpu >= CPU_SETSIZE) {
+                    throw std::invalid_argument("Worker: no such cpu");
+                }
+                if (node_queue[nodes[cpu]] == npos) {
+                    node_queue[nodes[cpu]] = queues_.size();
+                    queues_.push_back(std::make_unique<queue>());
+                }
+                thread_queue[i] = node_queue[nodes[cpu]];
+            }
+            cpu_queue_.resize(CPU_SETSIZE);
+            for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                cpu_queue_[cpu] = node_queue[nodes[cpu]];
+            }
+        }
+
+        for (std::size_t i = 0; i < threads; ++i) {
+            int cpu = options.cpus.empty() ? -1 : static_cast<int>(options.cpus[i % options.cpus.size()]);
+            threads_.emplace_back([this, cpu, q = thread_queue[i]]() { run(cpu, q); });
+            stops_.push_back(thread_queue[i]);
+        }
+    }
+
+    Worker(const Worker&)            = delete;
+    Worker& operator=(const Worker&) = delete;
+
+    // Runs the tasks queued so far and the ones they add, then stops the threads.
+    // Nothing may be added from outside meanwhile
+    ~Worker() override
+    {
+        for (std::size_t left = pending_.load(std::memory_order_acquire); left != 0;
+             left = pending_.load(std::memory_order_acquire)) {
+            pending_.wait(left, std::memory_order_acquire);
+        }
+        for (std::size_t q : stops_) {
+            queues_[q]->enqueue(queued_task {});
+        }
+        for (std::thread& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    // Future of what work returns, exceptions included. Work takes nothing or folly::Unit
+    template <typename Res, typename Work>
+    folly::Future<Res> doWork(Work&& work)
+    {
+        folly::Promise<Res> promise;
+        folly::Future<Res> future = promise.getFuture();
+        post([promise = std::move(promise), work = std::forward<Work>(work)]() mutable {
+            promise.setWith([&work]() -> Res {
+                if constexpr (std::is_invocable_v<decltype(work)&>) {
+                    return work();
+                } else {
+                    return work(folly::Unit {});
+                }
+            });
+        });
+        return future;
+    }
+
+    // Queues any callable as it is, without making a folly::Func of it first. Waits
+    // for room only when called from a thread that is not of a Worker
+    template <typename Func>
+    void post(Func&& func)
+    {
+        queued_task queued { worker_task(std::forward<Func>(func)), current_worker_ == nullptr };
+        if (queued.outside_) {
+            room_.acquire();
+        }
+        pending_.fetch_add(1, std::memory_order_relaxed);
+        queues_[queue_for_caller()]->enqueue(std::move(queued));
+    }
+
+    // An exception escaping the task is dropped, like CPUThreadPoolExecutor does after logging it
+    void add(folly::Func func) override
+    {
+        post([func = std::move(func)]() mutable {
+            try {
+                func();
+            } catch (...) {
+            }
+        });
+    }
+
+    folly::Executor& getExecutor() noexcept
+    {
+        return *this;
+    }
+
+    // Whether the calling thread is one of this worker
+    bool runs_here() const noexcept
+    {
+        return current_worker_ == this;
+    }
+
+    std::size_t numThreads() const noexcept
+    {
+        return threads_.size();
+    }
+
+private:
+    struct queued_task {
+        worker_task task_;
+        // Took room, gives it back when taken off the queue
+        bool outside_ = false;
+    };
+
+    using queue = folly::UMPMCQueue<queued_task, true>;
+
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+    static inline thread_local const Worker* current_worker_ = nullptr;
+    static inline thread_local std::size_t current_queue_    = 0;
+
+    std::vector<std::unique_ptr<queue>> queues_;
+    // Queue of the NUMA node of every CPU, npos for nodes without threads, empty when not pinned
+    std::vector<std::size_t> cpu_queue_;
+    std::atomic<std::size_t> next_ { 0 };
+    std::vector<std::thread> threads_;
+    std::vector<std::size_t> stops_;
+    std::counting_semaphore<> room_;
+    // Queued or running tasks, a task adding another one counts it before it is done itself
+    std::atomic<std::size_t> pending_ { 0 };
+
+    std::size_t queue_for_caller() noexcept
+    {
+        if (queues_.size() == 1) {
+            return 0;
+        }
+        if (current_worker_ == this) {
+            return current_queue_;
+        }
+        int cpu = sched_getcpu();
+        if (cpu >= 0 && static_cast<std::size_t>(cpu) < cpu_queue_.size() && cpu_queue_[cpu] != npos) {
+            return cpu_queue_[cpu];
+        }
+        return next_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    }
+
+    // A CPU the process may not use leaves the thread unpinned
+    void run(int cpu, std::size_t q)
+    {
+        if (cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+        current_worker_ = this;
+        current_queue_  = q;
+        for (;;) {
+            queued_task queued;
+            queues_[q]->dequeue(queued);
+            if (queued.outside_) {
+                room_.release();
+            }
+            if (!queued.task_) {
+                break;
+            }
+            queued.task_();
+            // Whatever the task holds is gone before ~Worker() may go on
+            queued.task_ = worker_task {};
+            if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                pending_.notify_all();
+            }
+        }
+        current_worker_ = nullptr;
+    }
+};
+
+// What a worker_stage did so far
+struct worker_stage_stats {
+    uint64_t inline_runs = 0;
+    uint64_t queued_runs = 0;
+    // From add() until a queued run started, the price of the hop
+    uint64_t wait_ns = 0;
+    // In the continuations themselves, inline and queued, less the stages they ran inline
+    uint64_t run_ns = 0;
+
+    double mean_wait_ns() const noexcept
+    {
+        return queued_runs == 0 ? 0.0 : static_cast<double>(wait_ns) / queued_runs;
+    }
+
+    double mean_run_ns() const noexcept
+    {
+        uint64_t runs = inline_runs + queued_runs;
+        return runs == 0 ? 0.0 : static_cast<double>(run_ns) / runs;
+    }
+};
+
+// Pipeline mode of a Worker, the executor of one stage in a future chain.
+//
+// A continuation added from a thread of the worker runs at once on that thread
+// instead of being queued, so a stage whose input is produced on its own worker
+// costs no hop, and consecutive stages on one worker run as a single task. Only
+// cheap stages belong here, a slow one holds up everything chained after it.
+// Continuations nest on the stack, past max_inline_depth they are queued again.
+// That never blocks, post() from a worker thread takes no room in the queue.
+// The stage must outlive the chains using it.
+class worker_stage : public folly::Executor {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr uint32_t max_inline_depth = 16;
+
+    explicit worker_stage(Worker& worker, std::string name = {})
+        : worker_(worker)
+        , name_(std::move(name))
+    {
+    }
+
+    worker_stage(const worker_stage&)            = delete;
+    worker_stage& operator=(const worker_stage&) = delete;
+
+    void add(folly::Func func) override
+    {
+        if (worker_.runs_here() && depth_ < max_inline_depth) {
+            inline_runs_.fetch_add(1, std::memory_order_relaxed);
+            ++depth_;
+            run(func);
+            --depth_;
+            return;
+        }
+        // Too deep or from another thread, only the latter may wait for room
+        worker_.post([this, func = std::move(func), queued = clock::now()]() mutable {
+            wait_ns_.fetch_add(nanoseconds_since(queued), std::memory_order_relaxed);
+            queued_runs_.fetch_add(1, std::memory_order_relaxed);
+            run(func);
+        });
+    }
+
+    const std::string& name() const noexcept
+    {
+        return name_;
+    }
+
+    // Counters move while chains run, they add up once the chains are done
+    worker_stage_stats stats() const noexcept
+    {
+        worker_stage_stats stats;
+        stats.inline_runs = inline_runs_.load(std::memory_order_relaxed);
+        stats.queued_runs = queued_runs_.load(std::memory_order_relaxed);
+        stats.wait_ns     = wait_ns_.load(std::memory_order_relaxed);
+        stats.run_ns      = run_ns_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    Worker& worker_;
+    std::string name_;
+    std::atomic<uint64_t> inline_runs_ { 0 };
+    std::atomic<uint64_t> queued_runs_ { 0 };
+    std::atomic<uint64_t> wait_ns_ { 0 };
+    std::atomic<uint64_t> run_ns_ { 0 };
+
+    static inline thread_local uint32_t depth_    = 0;
+    static inline thread_local uint64_t nested_ns_ = 0;
+
+    static uint64_t nanoseconds_since(clock::time_point start) noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+    }
+
+    // Dropped exceptions, as in Worker::add(). Stages run inline within this one
+    // count for themselves, not for it
+    void run(folly::Func& func) noexcept
+    {
+        uint64_t outer = nested_ns_;
+        nested_ns_     = 0;
+        auto start     = clock::now();
+        try {
+            func();
+        } catch (...) {
+        }
+        uint64_t ns = nanoseconds_since(start);
+        run_ns_.fetch_add(ns - std::min(ns, nested_ns_), std::memory_order_relaxed);
+        nested_ns_ = outer + ns;
+    }
+};
@@ -32,6 +32,7 @@ struct chunk_position_t {
 };
 
 static constexpr integer max_chunks_ { 512 };
+static constexpr size_t max_chunk_bytes_ { 8 * 1024 * 1024 };
 static constexpr integer loading_range_ { 4 };
 static constexpr integer chunk_reapiting_ { 64 };
 static constexpr Vector2 chunk_size_ { 64, 64 };
@@ -90,6 +91,19 @@ public:
         return position_;
     }
 
+    // GPU memory of the texture area the chunk draws
+    size_t gpu_bytes() const
+    {
+        return GetPixelDataSize(chunk_size_.x, chunk_size_.y, texture_.format);
+    }
+
+    struct weigher {
+        size_t operator()(const chunk_position_t&, const chunk_t& chunk) const
+        {
+            return chunk.gpu_bytes();
+        }
+    };
+
 private:
     Texture2D texture_;
     chunk_position_t position_;
@@ -98,7 +112,7 @@ private:
 class Map {
 public:
     Map()
-        : chunks_ { max_chunks_ }
+        : chunks_ { max_chunk_bytes_, max_chunks_ }
         , texture_ { 0 }
     {
         Image noise = GenImageChecked(chunk_reapiting_ * chunk_size_.x, chunk_reapiting_ * chunk_size_.y,
@@ -124,15 +138,15 @@ public:
         for (integer i = -loading_range_; i <= loading_range_; ++i) {
             for (integer j = -loading_range_; j <= loading_range_; ++j) {
                 chunk_position_t position_around { position.x + i, position.y + j };
-                if (!chunks_.contains(position_around)) {
-                    chunks_.put(position_around, chunk_t { position_around, texture_ });
-                }
+                chunks_.get_or_compute(position_around, [&]() { return chunk_t { position_around, texture_ }; });
             }
         }
     }
 
 private:
-    lru_map<chunk_position_t, chunk_t, chunk_position_t::hash, chunk_position_t::is_equal> chunks_;
+    lru_map<chunk_position_t, chunk_t, chunk_position_t::hash, chunk_position_t::is_equal, lru_node_pool, lru_policy,
+        chunk_t::weigher>
+        chunks_;
     Texture2D texture_;
 };
 
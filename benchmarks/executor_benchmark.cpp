@@ -0,0 +1,216 @@
+// Copyright 2024 Severin Denisenko
+
+#include <benchmark/benchmark.h>
+
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/Function.h>
+#include <folly/executors/ThreadedExecutor.h>
+#include <folly/futures/Future.h>
+#include <folly/futures/Promise.h>
+#include <folly/synchronization/Baton.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <latch>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "../Folly/work_stealing_executor.hpp"
+#include "../Folly/worker.hpp"
+
+// Task throughput and latency of the two executors used in Folly/.
+// CPUThreadPoolExecutor keeps a fixed set of threads, ThreadedExecutor
+// starts a new thread for every task. work_stealing_executor competes with
+// CPUThreadPoolExecutor on tasks that add more tasks. Worker of the future
+// demos is compared with the ThreadedExecutor one it replaced, and with its
+// pipeline stages that run continuations inline.
+
+static constexpr std::ptrdiff_t batch_ { 1 << 12 };
+
+// Submits tasks and waits until every one of them ran
+template <typename Executor>
+static void run_batch(Executor& executor, std::ptrdiff_t tasks)
+{
+    std::latch done { tasks };
+    for (std::ptrdiff_t task = 0; task < tasks; ++task) {
+        executor.add([&done]() { done.count_down(); });
+    }
+    done.wait();
+}
+
+static void cpu_pool_throughput(benchmark::State& state)
+{
+    folly::CPUThreadPoolExecutor executor { static_cast<std::size_t>(state.range(0)) };
+    for (auto _ : state) {
+        run_batch(executor, batch_);
+    }
+    state.SetItemsProcessed(state.iterations() * batch_);
+}
+BENCHMARK(cpu_pool_throughput)->ArgName("threads")->RangeMultiplier(2)->Range(1, 16)->UseRealTime();
+
+// Executor is destroyed inside the timed loop, its destructor joins the task threads
+static void threaded_throughput(benchmark::State& state)
+{
+    for (auto _ : state) {
+        folly::ThreadedExecutor executor;
+        run_batch(executor, state.range(0));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(threaded_throughput)->ArgName("tasks")->Arg(64)->Arg(1024)->UseRealTime();
+
+// Time from add() until the submitting thread learns the task ran,
+// with as many submitting threads as the benchmark runs
+static void cpu_pool_round_trip(benchmark::State& state)
+{
+    static folly::CPUThreadPoolExecutor executor { std::max(1u, std::thread::hardware_concurrency()) };
+    for (auto _ : state) {
+        folly::Baton<> baton;
+        executor.add([&baton]() { baton.post(); });
+        baton.wait();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(cpu_pool_round_trip)->ThreadRange(1, 8)->UseRealTime();
+
+// Every benchmark thread has its own executor, which joins finished task threads as it goes
+static void threaded_round_trip(benchmark::State& state)
+{
+    folly::ThreadedExecutor executor;
+    for (auto _ : state) {
+        folly::Baton<> baton;
+        executor.add([&baton]() { baton.post(); });
+        baton.wait();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(threaded_round_trip)->ThreadRange(1, 8)->UseRealTime();
+
+static constexpr int tree_depth_ { 12 };
+
+static void thread_counts(benchmark::internal::Benchmark* bench)
+{
+    bench->ArgName("threads")->RangeMultiplier(2)->Range(1, 16)->UseRealTime();
+}
+
+// A task on the executor adds a batch of tiny tasks, the submitter waits for all of them
+template <typename Executor>
+static void fan_out(benchmark::State& state)
+{
+    Executor executor { static_cast<std::size_t>(state.range(0)) };
+    for (auto _ : state) {
+        std::latch done { batch_ };
+        executor.add([&executor, &done]() {
+            for (std::ptrdiff_t task = 0; task < batch_; ++task) {
+                executor.add([&done]() { done.count_down(); });
+            }
+        });
+        done.wait();
+    }
+    state.SetItemsProcessed(state.iterations() * batch_);
+}
+BENCHMARK_TEMPLATE(fan_out, folly::CPUThreadPoolExecutor)->Apply(thread_counts);
+BENCHMARK_TEMPLATE(fan_out, work_stealing_executor)->Apply(thread_counts);
+
+// Every task adds two children until depth runs out, like divide and conquer does
+template <typename Executor>
+static void spawn_tree(Executor& executor, int depth, std::atomic<int64_t>& pending, folly::Baton<>& done)
+{
+    if (depth > 0) {
+        pending.fetch_add(2, std::memory_order_relaxed);
+        for (int child = 0; child < 2; ++child) {
+            executor.add([&executor, depth, &pending, &done]() { spawn_tree(executor, depth - 1, pending, done); });
+        }
+    }
+    if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        done.post();
+    }
+}
+
+template <typename Executor>
+static void recursive(benchmark::State& state)
+{
+    Executor executor { static_cast<std::size_t>(state.range(0)) };
+    for (auto _ : state) {
+        std::atomic<int64_t> pending { 1 };
+        folly::Baton<> done;
+        executor.add([&executor, &pending, &done]() { spawn_tree(executor, tree_depth_, pending, done); });
+        done.wait();
+    }
+    state.SetItemsProcessed(state.iterations() * ((int64_t { 2 } << tree_depth_) - 1));
+}
+BENCHMARK_TEMPLATE(recursive, folly::CPUThreadPoolExecutor)->Apply(thread_counts);
+BENCHMARK_TEMPLATE(recursive, work_stealing_executor)->Apply(thread_counts);
+
+// Worker of Folly/future_simple.cpp before it moved to Folly/worker.hpp
+class threaded_worker {
+public:
+    template <typename Res>
+    folly::Future<Res> doWork(folly::Function<Res(void)> work)
+    {
+        folly::Promise<Res> promise;
+        folly::Future<Res> future = promise.getFuture();
+        executor_.add([promise = std::move(promise), work = std::move(work)]() mutable { promise.setValue(work()); });
+        return future;
+    }
+
+private:
+    folly::ThreadedExecutor executor_;
+};
+
+// Time from doWork() until the caller holds the result
+template <typename Pool>
+static void worker_round_trip(benchmark::State& state)
+{
+    Pool worker;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(worker.template doWork<int>([]() { return 1; }).get());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(worker_round_trip, threaded_worker)->UseRealTime();
+BENCHMARK_TEMPLATE(worker_round_trip, Worker)->UseRealTime();
+
+// Same with a thread pinned to every CPU and a queue per NUMA node
+static void worker_pinned_round_trip(benchmark::State& state)
+{
+    std::vector<unsigned> cpus = worker_cpus();
+    Worker worker { { .threads = cpus.size(), .cpus = cpus } };
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(worker.doWork<int>([]() { return 1; }).get());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(worker_pinned_round_trip)->UseRealTime();
+
+static constexpr int pipeline_stages_ { 4 };
+
+// A chain of stages on one Worker, every stage queued through getExecutor()
+// (inline:0) or through a worker_stage (inline:1), which runs the stages after
+// the first one in the task of the previous stage
+static void worker_pipeline(benchmark::State& state)
+{
+    std::optional<Worker> worker { std::in_place };
+    worker_stage stage { *worker };
+    folly::Executor& executor = state.range(0) == 0 ? worker->getExecutor() : static_cast<folly::Executor&>(stage);
+    for (auto _ : state) {
+        folly::Future<int> future = worker->doWork<int>([]() { return 0; });
+        for (int i = 1; i < pipeline_stages_; ++i) {
+            future = std::move(future).via(&executor).thenValue([](int value) { return value + 1; });
+        }
+        benchmark::DoNotOptimize(std::move(future).get());
+    }
+    worker.reset();
+    state.SetItemsProcessed(state.iterations() * pipeline_stages_);
+
+    worker_stage_stats stats       = stage.stats();
+    state.counters["inline_runs"]  = benchmark::Counter(stats.inline_runs, benchmark::Counter::kAvgIterations);
+    state.counters["queued_runs"]  = benchmark::Counter(stats.queued_runs, benchmark::Counter::kAvgIterations);
+    state.counters["mean_wait_ns"] = stats.mean_wait_ns();
+}
+BENCHMARK(worker_pipeline)->ArgName("inline")->Arg(0)->Arg(1)->UseRealTime();
+
+BENCHMARK_MAIN();
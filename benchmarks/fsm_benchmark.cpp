@@ -0,0 +1,222 @@
+// Copyright 2024 Severin Denisenko
+
+#include <benchmark/benchmark.h>
+#include <malloc.h>
+
+#include <folly/executors/CPUThreadPoolExecutor.h>
+
+#include <boost/msm/back/state_machine.hpp>
+#include <boost/msm/front/state_machine_def.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../Boost/table_state_machine.hpp"
+#include "../Folly/fsm_runtime.hpp"
+
+// The lamp of Boost/state_mashine.cpp without printing, run by the MSM back-end
+// and by table_state_machine. bytes is the heap one of many instances takes as
+// counted by glibc, including what its constructor allocates. fsm_runtime runs
+// many table lamps on a thread pool, against the same batch applied in a loop.
+// traced_lamp pays for a record of every event, table_lamp traces nothing.
+
+namespace msm = boost::msm;
+namespace mpl = boost::mpl;
+
+struct turn_on {
+    bool hot;
+};
+struct turn_off { };
+struct burn_out { };
+
+struct lamp_ : public msm::front::state_machine_def<lamp_> {
+    struct On : public msm::front::state<> {
+        using deferred_events = mpl::vector<turn_on>;
+    };
+
+    struct Off : public msm::front::state<> {
+        using deferred_events = mpl::vector<turn_off, burn_out>;
+    };
+
+    struct Burned : public msm::front::state<> { };
+
+    using initial_state = mpl::vector<Off>;
+
+    void turned_on(turn_on const&)
+    {
+    }
+
+    void turned_off(turn_off const&)
+    {
+    }
+
+    void burned(burn_out const&)
+    {
+    }
+
+    bool can_turn_on(turn_on const& ev)
+    {
+        return ev.hot;
+    }
+
+    bool always(auto const&)
+    {
+        return true;
+    }
+
+    using l = lamp_;
+
+    // clang-format off
+    struct transition_table : mpl::vector<
+        row<Off,  turn_on,   On,      &l::turned_on,   &l::can_turn_on>,
+        row<On,   turn_off,  Off,     &l::turned_off,  &l::always>,
+        row<On,   burn_out,  Burned,  &l::burned,      &l::always>>
+    { };
+    // clang-format on
+
+    template <class FSM, class Event>
+    void no_transition(Event const&, FSM&, int)
+    {
+    }
+};
+
+using msm_lamp   = msm::back::state_machine<lamp_>;
+using table_lamp  = table_state_machine<lamp_, 4>;
+using traced_lamp = table_state_machine<lamp_, 4, fsm_ring_trace<>>;
+
+// One lamp switched on and off
+template <typename Lamp>
+static void fsm_switch(benchmark::State& state)
+{
+    Lamp lamp;
+    lamp.start();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lamp.process_event(turn_on { .hot = true }));
+        benchmark::DoNotOptimize(lamp.process_event(turn_off {}));
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK_TEMPLATE(fsm_switch, msm_lamp);
+BENCHMARK_TEMPLATE(fsm_switch, table_lamp);
+BENCHMARK_TEMPLATE(fsm_switch, traced_lamp);
+
+// A second turn_on is deferred while on and replayed by the turn_off
+template <typename Lamp>
+static void fsm_deferred(benchmark::State& state)
+{
+    Lamp lamp;
+    lamp.start();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lamp.process_event(turn_on { .hot = true }));
+        benchmark::DoNotOptimize(lamp.process_event(turn_on { .hot = true }));
+        benchmark::DoNotOptimize(lamp.process_event(turn_off {}));
+        benchmark::DoNotOptimize(lamp.process_event(turn_off {}));
+    }
+    state.SetItemsProcessed(state.iterations() * 4);
+}
+BENCHMARK_TEMPLATE(fsm_deferred, msm_lamp);
+BENCHMARK_TEMPLATE(fsm_deferred, table_lamp);
+BENCHMARK_TEMPLATE(fsm_deferred, traced_lamp);
+
+// Events for random lamps out of many, every lamp sees on and off in turn
+template <typename Lamp>
+static void fsm_many(benchmark::State& state)
+{
+    std::size_t count  = state.range(0);
+    std::size_t before = mallinfo2().uordblks;
+    std::vector<Lamp> lamps(count);
+    for (Lamp& lamp : lamps) {
+        lamp.start();
+    }
+    state.counters["bytes"] = static_cast<double>(mallinfo2().uordblks - before) / count;
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<uint32_t> pick(0, count - 1);
+    std::vector<bool> on(count, false);
+    std::vector<std::pair<uint32_t, bool>> events(1 << 16);
+    for (auto& [lamp, turn] : events) {
+        lamp = pick(rng);
+        turn = on[lamp] = !on[lamp];
+    }
+
+    std::size_t i = 0;
+    for (auto _ : state) {
+        auto [lamp, turn] = events[i++ % events.size()];
+        if (turn) {
+            benchmark::DoNotOptimize(lamps[lamp].process_event(turn_on { .hot = true }));
+        } else {
+            benchmark::DoNotOptimize(lamps[lamp].process_event(turn_off {}));
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(fsm_many, msm_lamp)->ArgName("lamps")->RangeMultiplier(32)->Range(1 << 10, 1 << 20);
+BENCHMARK_TEMPLATE(fsm_many, table_lamp)->ArgName("lamps")->RangeMultiplier(32)->Range(1 << 10, 1 << 20);
+
+using runtime_t = fsm_runtime<table_lamp>;
+
+// Every lamp gets on and off in turn and ends the batch off, so batches can repeat
+static std::vector<runtime_t::message> lamp_batch(std::size_t count, std::size_t size)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<uint32_t> pick(0, count - 1);
+    std::vector<bool> on(count, false);
+    std::vector<runtime_t::message> batch;
+    batch.reserve(size + count);
+    for (std::size_t i = 0; i < size; ++i) {
+        uint32_t lamp = pick(rng);
+        on[lamp]      = !on[lamp];
+        if (on[lamp]) {
+            batch.push_back({ lamp, turn_on { .hot = true } });
+        } else {
+            batch.push_back({ lamp, turn_off {} });
+        }
+    }
+    for (uint32_t lamp = 0; lamp < count; ++lamp) {
+        if (on[lamp]) {
+            batch.push_back({ lamp, turn_off {} });
+        }
+    }
+    return batch;
+}
+
+static constexpr std::size_t runtime_lamps_ { 1 << 18 };
+static constexpr std::size_t runtime_batch_ { 1 << 20 };
+
+// What fsm_runtime saves a caller from: one thread, one event after another
+static void fsm_batch_loop(benchmark::State& state)
+{
+    std::vector<table_lamp> lamps(runtime_lamps_);
+    for (table_lamp& lamp : lamps) {
+        lamp.start();
+    }
+    auto batch = lamp_batch(runtime_lamps_, runtime_batch_);
+
+    for (auto _ : state) {
+        for (const auto& m : batch) {
+            std::visit([&lamps, &m](const auto& event) { lamps[m.id].process_event(event); }, m.event);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * batch.size());
+}
+BENCHMARK(fsm_batch_loop)->UseRealTime();
+
+// Same batch split by lamp over a pool of threads
+static void fsm_batch_runtime(benchmark::State& state)
+{
+    folly::CPUThreadPoolExecutor executor { static_cast<std::size_t>(state.range(0)) };
+    runtime_t runtime { runtime_lamps_, executor, static_cast<std::size_t>(state.range(0)) };
+    auto batch = lamp_batch(runtime_lamps_, runtime_batch_);
+
+    for (auto _ : state) {
+        runtime.process(batch);
+    }
+    state.SetItemsProcessed(state.iterations() * batch.size());
+}
+BENCHMARK(fsm_batch_runtime)->ArgName("threads")->RangeMultiplier(2)->Range(1, 16)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,341 @@
+// Copyright 2024 Severin Denisenko
+
+#include <benchmark/benchmark.h>
+
+#include <boost/container/flat_set.hpp>
+#include <boost/icl/interval_map.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "../Boost/interval_index.hpp"
+#include "../Boost/roaring_set.hpp"
+
+// boost::icl::interval_map as used in Boost/interval_tree.cpp: every interval
+// carries a set of ids, overlapping intervals are split and their sets merged.
+// interval_index answers the same queries from flat arrays built once.
+// Arguments are the number of intervals and their mean length, which decides
+// how much they overlap in the 2^20 wide domain. Benchmarks taking the id set
+// type compare flat_set with the shared compressed blocks of roaring_set.
+
+using number_t       = uint32_t;
+using set_t          = boost::container::flat_set<number_t>;
+using interval_map_t = boost::icl::interval_map<number_t, set_t>;
+using interval_t     = boost::icl::discrete_interval<number_t>;
+using segment_t      = std::pair<interval_t, set_t>;
+using index_t        = interval_index<number_t, number_t>;
+
+template <typename Set>
+using map_of = boost::icl::interval_map<number_t, Set>;
+
+static constexpr number_t domain_ { 1 << 20 };
+
+template <typename Set = set_t>
+static std::vector<std::pair<interval_t, Set>> make_segments(
+    std::size_t count, number_t mean_length, uint32_t seed = 42)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<number_t> start(0, domain_ - 1);
+    std::uniform_int_distribution<number_t> length(1, 2 * mean_length);
+
+    std::vector<std::pair<interval_t, Set>> segments;
+    segments.reserve(count);
+    for (number_t id = 0; id < count; ++id) {
+        number_t lower = start(rng);
+        segments.emplace_back(interval_t::right_open(lower, lower + length(rng)), Set { id });
+    }
+    return segments;
+}
+
+template <typename Set>
+static map_of<Set> make_map(const std::vector<std::pair<interval_t, Set>>& segments)
+{
+    map_of<Set> map;
+    for (const auto& segment : segments) {
+        map += segment;
+    }
+    return map;
+}
+
+static void counts_and_lengths(benchmark::internal::Benchmark* bench)
+{
+    for (int64_t count : { 1 << 10, 1 << 14 }) {
+        for (int64_t length : { 16, 1024 }) {
+            bench->Args({ count, length });
+        }
+    }
+    bench->ArgNames({ "intervals", "length" });
+}
+
+// Same plus about a thousand ids on every segment, where copying sets dominates
+static void heavy_overlap(benchmark::internal::Benchmark* bench)
+{
+    counts_and_lengths(bench);
+    bench->Args({ 1 << 14, 1 << 16 });
+}
+
+static std::size_t set_bytes(const set_t& set)
+{
+    return sizeof(set) + set.capacity() * sizeof(number_t);
+}
+
+static std::size_t set_bytes(const roaring_set& set)
+{
+    return set.memory_usage();
+}
+
+// Builds the map from scratch, rebuilding is not timed
+template <typename Set>
+static void interval_map_add(benchmark::State& state)
+{
+    auto segments = make_segments<Set>(state.range(0), state.range(1));
+
+    map_of<Set> map;
+    std::size_t i = 0;
+    for (auto _ : state) {
+        if (i == segments.size()) {
+            state.PauseTiming();
+            map.clear();
+            i = 0;
+            state.ResumeTiming();
+        }
+        map += segments[i++];
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(interval_map_add, set_t)->Apply(heavy_overlap);
+BENCHMARK_TEMPLATE(interval_map_add, roaring_set)->Apply(heavy_overlap);
+
+// Whole map from the same segments in one sweep, items are segments so the rate compares to interval_map_add
+static void interval_map_bulk(benchmark::State& state)
+{
+    auto segments = make_segments(state.range(0), state.range(1));
+
+    for (auto _ : state) {
+        interval_map_t map = make_interval_map<interval_map_t, set_t>(segments);
+        benchmark::DoNotOptimize(map.iterative_size());
+    }
+    state.SetItemsProcessed(state.iterations() * segments.size());
+}
+BENCHMARK(interval_map_bulk)->Apply(counts_and_lengths);
+
+// Removes intervals until the map is empty, refilling is not timed
+template <typename Set>
+static void interval_map_subtract(benchmark::State& state)
+{
+    auto segments = make_segments<Set>(state.range(0), state.range(1));
+
+    map_of<Set> map = make_map(segments);
+    std::size_t i   = 0;
+    for (auto _ : state) {
+        if (i == segments.size()) {
+            state.PauseTiming();
+            map = make_map(segments);
+            i   = 0;
+            state.ResumeTiming();
+        }
+        map -= segments[i++];
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(interval_map_subtract, set_t)->Apply(heavy_overlap);
+BENCHMARK_TEMPLATE(interval_map_subtract, roaring_set)->Apply(heavy_overlap);
+
+// Copies the whole map, bytes counts every set as if it shared nothing
+template <typename Set>
+static void interval_map_copy(benchmark::State& state)
+{
+    map_of<Set> map = make_map(make_segments<Set>(state.range(0), state.range(1)));
+
+    for (auto _ : state) {
+        map_of<Set> copy = map;
+        benchmark::DoNotOptimize(copy.iterative_size());
+    }
+    std::size_t bytes = 0;
+    for (const auto& [interval, ids] : map) {
+        bytes += set_bytes(ids);
+    }
+    state.SetItemsProcessed(state.iterations() * map.iterative_size());
+    state.counters["bytes"] = bytes;
+}
+BENCHMARK_TEMPLATE(interval_map_copy, set_t)->Apply(heavy_overlap);
+BENCHMARK_TEMPLATE(interval_map_copy, roaring_set)->Apply(heavy_overlap);
+
+// Ids of all intervals covering a point
+static void interval_map_stab(benchmark::State& state)
+{
+    auto segments      = make_segments(state.range(0), state.range(1));
+    interval_map_t map = make_map(segments);
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<number_t> point(0, domain_ - 1);
+    std::vector<number_t> points(1 << 16);
+    for (auto& p : points) {
+        p = point(rng);
+    }
+
+    std::size_t found = 0;
+    std::size_t i     = 0;
+    for (auto _ : state) {
+        auto it = map.find(points[i++ % points.size()]);
+        if (it != map.end()) {
+            found += it->second.size();
+        }
+    }
+    benchmark::DoNotOptimize(found);
+    state.SetItemsProcessed(state.iterations());
+    state.counters["segments"] = map.iterative_size();
+}
+BENCHMARK(interval_map_stab)->Apply(counts_and_lengths);
+
+// Walks every segment overlapping a query interval of the mean length
+static void interval_map_range(benchmark::State& state)
+{
+    auto segments      = make_segments(state.range(0), state.range(1));
+    interval_map_t map = make_map(segments);
+    auto queries       = make_segments(1 << 16, state.range(1), 7);
+
+    std::size_t found = 0;
+    std::size_t i     = 0;
+    for (auto _ : state) {
+        auto [first, last] = map.equal_range(queries[i++ % queries.size()].first);
+        for (auto it = first; it != last; ++it) {
+            found += it->second.size();
+        }
+    }
+    benchmark::DoNotOptimize(found);
+    state.SetItemsProcessed(state.iterations());
+    state.counters["segments"] = map.iterative_size();
+}
+BENCHMARK(interval_map_range)->Apply(counts_and_lengths);
+
+static index_t make_index(const std::vector<segment_t>& segments)
+{
+    std::vector<index_t::entry> entries;
+    entries.reserve(segments.size());
+    for (const auto& [interval, ids] : segments) {
+        entries.emplace_back(interval, *ids.begin());
+    }
+    return index_t(entries);
+}
+
+static void interval_index_build(benchmark::State& state)
+{
+    auto segments = make_segments(state.range(0), state.range(1));
+
+    for (auto _ : state) {
+        index_t index = make_index(segments);
+        benchmark::DoNotOptimize(index.segment_count());
+    }
+    state.SetItemsProcessed(state.iterations() * segments.size());
+}
+BENCHMARK(interval_index_build)->Apply(counts_and_lengths);
+
+// Same points as interval_map_stab
+static void interval_index_stab(benchmark::State& state)
+{
+    auto segments = make_segments(state.range(0), state.range(1));
+    index_t index = make_index(segments);
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<number_t> point(0, domain_ - 1);
+    std::vector<number_t> points(1 << 16);
+    for (auto& p : points) {
+        p = point(rng);
+    }
+
+    std::size_t found = 0;
+    std::size_t i     = 0;
+    for (auto _ : state) {
+        index.stab(points[i++ % points.size()], [&found](number_t) { ++found; });
+    }
+    benchmark::DoNotOptimize(found);
+    state.SetItemsProcessed(state.iterations());
+    state.counters["segments"] = index.segment_count();
+}
+BENCHMARK(interval_index_stab)->Apply(counts_and_lengths);
+
+// Same kind of points as interval_index_stab, ten thousand per request answered in one sweep
+static void interval_index_batch(benchmark::State& state, index_t::batch_order order)
+{
+    auto segments = make_segments(state.range(0), state.range(1));
+    index_t index = make_index(segments);
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<number_t> point(0, domain_ - 1);
+    std::vector<number_t> points(10000);
+    for (auto& p : points) {
+        p = point(rng);
+    }
+    if (order == index_t::batch_order::sorted) {
+        std::sort(points.begin(), points.end());
+    }
+
+    index_t::batch out;
+    for (auto _ : state) {
+        index.stab(points, out, order);
+        benchmark::DoNotOptimize(out[points.size() - 1].data());
+    }
+    state.SetItemsProcessed(state.iterations() * points.size());
+    state.counters["segments"] = index.segment_count();
+}
+BENCHMARK_CAPTURE(interval_index_batch, sorted, index_t::batch_order::sorted)->Apply(counts_and_lengths);
+BENCHMARK_CAPTURE(interval_index_batch, unsorted, index_t::batch_order::unsorted)->Apply(counts_and_lengths);
+
+// Baseline of interval_index_batch: the same points stabbed one at a time into
+// the same kind of CSR buffer, reused between requests
+static void interval_index_batch_loop(benchmark::State& state, index_t::batch_order order)
+{
+    auto segments = make_segments(state.range(0), state.range(1));
+    index_t index = make_index(segments);
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<number_t> point(0, domain_ - 1);
+    std::vector<number_t> points(10000);
+    for (auto& p : points) {
+        p = point(rng);
+    }
+    if (order == index_t::batch_order::sorted) {
+        std::sort(points.begin(), points.end());
+    }
+
+    std::vector<number_t> ids;
+    std::vector<std::size_t> offsets;
+    for (auto _ : state) {
+        ids.clear();
+        offsets.assign(1, 0);
+        for (number_t p : points) {
+            index.stab(p, [&ids](number_t id) { ids.push_back(id); });
+            offsets.push_back(ids.size());
+        }
+        benchmark::DoNotOptimize(ids.data());
+    }
+    state.SetItemsProcessed(state.iterations() * points.size());
+    state.counters["segments"] = index.segment_count();
+}
+BENCHMARK_CAPTURE(interval_index_batch_loop, sorted, index_t::batch_order::sorted)->Apply(counts_and_lengths);
+BENCHMARK_CAPTURE(interval_index_batch_loop, unsorted, index_t::batch_order::unsorted)->Apply(counts_and_lengths);
+
+// Same queries as interval_map_range, but every id is reported once instead of once per segment
+static void interval_index_range(benchmark::State& state)
+{
+    auto segments = make_segments(state.range(0), state.range(1));
+    index_t index = make_index(segments);
+    auto queries  = make_segments(1 << 16, state.range(1), 7);
+
+    std::size_t found = 0;
+    std::size_t i     = 0;
+    for (auto _ : state) {
+        index.stab(queries[i++ % queries.size()].first, [&found](number_t) { ++found; });
+    }
+    benchmark::DoNotOptimize(found);
+    state.SetItemsProcessed(state.iterations());
+    state.counters["segments"] = index.segment_count();
+}
+BENCHMARK(interval_index_range)->Apply(counts_and_lengths);
+
+BENCHMARK_MAIN();
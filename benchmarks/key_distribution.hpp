@@ -0,0 +1,90 @@
+// Copyright 2024 Severin Denisenko
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Key streams shared by the benchmarks. They are generated before timing
+// starts, so a benchmark measures the container and not the random generator.
+
+using number_t = uint64_t;
+using keys_t   = std::vector<number_t>;
+
+enum class distribution : int64_t {
+    uniform,
+    zipf,
+    scan,
+};
+
+inline const char* distribution_name(distribution dist)
+{
+    switch (dist) {
+    case distribution::uniform:
+        return "uniform";
+    case distribution::zipf:
+        return "zipf";
+    case distribution::scan:
+        return "scan";
+    }
+    return "unknown";
+}
+
+// Every key of the universe is equally likely
+inline keys_t uniform_keys(std::size_t count, number_t universe, uint64_t seed = 42)
+{
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<number_t> dist(0, universe - 1);
+
+    keys_t keys(count);
+    for (auto& key : keys) {
+        key = dist(rng);
+    }
+    return keys;
+}
+
+// Key i is drawn with probability proportional to 1 / (i + 1)^skew, like the hot set of a real cache
+inline keys_t zipf_keys(std::size_t count, number_t universe, double skew = 0.9, uint64_t seed = 42)
+{
+    std::vector<double> cdf(universe);
+    double total = 0;
+    for (number_t i = 0; i < universe; ++i) {
+        total += 1.0 / std::pow(i + 1, skew);
+        cdf[i] = total;
+    }
+
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> dist(0, total);
+
+    keys_t keys(count);
+    for (auto& key : keys) {
+        key = std::min<number_t>(std::upper_bound(cdf.begin(), cdf.end(), dist(rng)) - cdf.begin(), universe - 1);
+    }
+    return keys;
+}
+
+// Walks the universe in order, the worst case for LRU once it exceeds capacity
+inline keys_t scan_keys(std::size_t count, number_t universe)
+{
+    keys_t keys(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        keys[i] = i % universe;
+    }
+    return keys;
+}
+
+inline keys_t make_keys(distribution dist, std::size_t count, number_t universe)
+{
+    switch (dist) {
+    case distribution::uniform:
+        return uniform_keys(count, universe);
+    case distribution::zipf:
+        return zipf_keys(count, universe);
+    case distribution::scan:
+        return scan_keys(count, universe);
+    }
+    return {};
+}
@@ -0,0 +1,173 @@
+// Copyright 2024 Severin Denisenko
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "../Boost/lru_map.hpp"
+#include "../Boost/lru_set.hpp"
+#include "key_distribution.hpp"
+
+// Arguments are capacity and key distribution. Keys come from a universe
+// twice the capacity, so uniform keys hit about half of the time.
+
+static constexpr std::size_t stream_size_ { 1 << 16 };
+
+// Keys per get_many()/put_many() call, like a request handler looking up a page of ids
+static constexpr std::size_t batch_size_ { 256 };
+
+using map_t = lru_map<number_t, number_t>;
+using set_t = lru_set<number_t>;
+
+static void capacities_and_distributions(benchmark::internal::Benchmark* bench)
+{
+    for (int64_t capacity : { 1 << 10, 1 << 14, 1 << 18 }) {
+        for (distribution dist : { distribution::uniform, distribution::zipf, distribution::scan }) {
+            bench->Args({ capacity, static_cast<int64_t>(dist) });
+        }
+    }
+    bench->ArgNames({ "capacity", "distribution" });
+}
+
+template <typename Container>
+static void fill(Container& container, std::size_t capacity)
+{
+    for (number_t key = 0; key < capacity; ++key) {
+        if constexpr (std::is_same_v<Container, set_t>) {
+            container.put(key);
+        } else {
+            container.put(key, number_t { key });
+        }
+    }
+}
+
+static void report(benchmark::State& state, std::size_t hits)
+{
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(distribution_name(static_cast<distribution>(state.range(1))));
+    state.counters["hit_ratio"] = static_cast<double>(hits) / state.iterations();
+}
+
+static void lru_map_put(benchmark::State& state)
+{
+    std::size_t capacity = state.range(0);
+    keys_t keys          = make_keys(static_cast<distribution>(state.range(1)), stream_size_, 2 * capacity);
+
+    map_t map { capacity };
+    fill(map, capacity);
+
+    std::size_t hits = 0;
+    std::size_t i    = 0;
+    for (auto _ : state) {
+        number_t key = keys[i++ % keys.size()];
+        hits += !map.put(key, number_t { key });
+    }
+    report(state, hits);
+}
+BENCHMARK(lru_map_put)->Apply(capacities_and_distributions);
+
+static void lru_map_contains(benchmark::State& state)
+{
+    std::size_t capacity = state.range(0);
+    keys_t keys          = make_keys(static_cast<distribution>(state.range(1)), stream_size_, 2 * capacity);
+
+    map_t map { capacity };
+    fill(map, capacity);
+
+    std::size_t hits = 0;
+    std::size_t i    = 0;
+    for (auto _ : state) {
+        bool found = map.contains(keys[i++ % keys.size()]);
+        benchmark::DoNotOptimize(found);
+        hits += found;
+    }
+    report(state, hits);
+}
+BENCHMARK(lru_map_contains)->Apply(capacities_and_distributions);
+
+// Same key stream as lru_map_contains, a batch at a time. Items are keys, so the rates compare directly
+static void lru_map_get_many(benchmark::State& state)
+{
+    std::size_t capacity = state.range(0);
+    keys_t keys          = make_keys(static_cast<distribution>(state.range(1)), stream_size_, 2 * capacity);
+
+    map_t map { capacity };
+    fill(map, capacity);
+
+    std::vector<number_t*> values(batch_size_);
+    std::size_t hits = 0;
+    std::size_t i    = 0;
+    for (auto _ : state) {
+        hits += map.get_many(std::span(keys).subspan(i, batch_size_), values);
+        benchmark::DoNotOptimize(values.data());
+        i = (i + batch_size_) % keys.size();
+    }
+    report(state, hits);
+    state.SetItemsProcessed(state.iterations() * batch_size_);
+    state.counters["hit_ratio"] = static_cast<double>(hits) / (state.iterations() * batch_size_);
+}
+BENCHMARK(lru_map_get_many)->Apply(capacities_and_distributions);
+
+static void lru_map_put_many(benchmark::State& state)
+{
+    std::size_t capacity = state.range(0);
+    keys_t keys          = make_keys(static_cast<distribution>(state.range(1)), stream_size_, 2 * capacity);
+
+    map_t map { capacity };
+    fill(map, capacity);
+
+    std::vector<number_t> values(batch_size_);
+    std::size_t hits = 0;
+    std::size_t i    = 0;
+    for (auto _ : state) {
+        auto batch = std::span(keys).subspan(i, batch_size_);
+        std::copy(batch.begin(), batch.end(), values.begin());
+        hits += batch_size_ - map.put_many(batch, values);
+        i = (i + batch_size_) % keys.size();
+    }
+    report(state, hits);
+    state.SetItemsProcessed(state.iterations() * batch_size_);
+    state.counters["hit_ratio"] = static_cast<double>(hits) / (state.iterations() * batch_size_);
+}
+BENCHMARK(lru_map_put_many)->Apply(capacities_and_distributions);
+
+static void lru_set_put(benchmark::State& state)
+{
+    std::size_t capacity = state.range(0);
+    keys_t keys          = make_keys(static_cast<distribution>(state.range(1)), stream_size_, 2 * capacity);
+
+    set_t set { capacity };
+    fill(set, capacity);
+
+    std::size_t hits = 0;
+    std::size_t i    = 0;
+    for (auto _ : state) {
+        hits += !set.put(keys[i++ % keys.size()]);
+    }
+    report(state, hits);
+}
+BENCHMARK(lru_set_put)->Apply(capacities_and_distributions);
+
+static void lru_set_contains(benchmark::State& state)
+{
+    std::size_t capacity = state.range(0);
+    keys_t keys          = make_keys(static_cast<distribution>(state.range(1)), stream_size_, 2 * capacity);
+
+    set_t set { capacity };
+    fill(set, capacity);
+
+    std::size_t hits = 0;
+    std::size_t i    = 0;
+    for (auto _ : state) {
+        bool found = set.contains(keys[i++ % keys.size()]);
+        benchmark::DoNotOptimize(found);
+        hits += found;
+    }
+    report(state, hits);
+}
+BENCHMARK(lru_set_contains)->Apply(capacities_and_distributions);
+
+BENCHMARK_MAIN();